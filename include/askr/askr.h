@@ -21,6 +21,18 @@
 
 #include <bitset>
 
+// The highest debug level compiled in, anything above it is compiled out. See --with-debug-max-level.
+#ifndef ASKR_DEBUG_MAX_LEVEL
+#define ASKR_DEBUG_MAX_LEVEL 6
+#endif
+
+// C++20's [[unlikely]], which GCC also takes in C++17 mode (clang warns about it with -pedantic)
+#if __cplusplus >= 202002L || (defined(__GNUC__) && !defined(__clang__))
+#define ASKR_UNLIKELY [[unlikely]]
+#else
+#define ASKR_UNLIKELY
+#endif
+
 namespace askr
 {
 namespace debug
@@ -46,10 +58,39 @@ namespace debug
      */
     extern std::bitset<16> gLevel;
 
+    /**
+     * @brief Check if a debug level is enabled, at runtime. Levels above ASKR_DEBUG_MAX_LEVEL are never enabled.
+     *
+     * @param level   The debug level
+     * @return        True if the level is enabled
+     */
     inline bool
     Do(Levels level)
     {
-        return gLevel[level];
+        if (level <= ASKR_DEBUG_MAX_LEVEL && gLevel[level]) ASKR_UNLIKELY {
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Check if a debug level is enabled, where the level is known at compile time. For levels above
+     *        ASKR_DEBUG_MAX_LEVEL this is a constant false, so the debugging code is compiled out entirely. Use this
+     *        on hot paths, e.g. per record, such as
+     *
+     *            if (askr::debug::Do<askr::debug::PLUGIN_DETAILS>()) { ... }
+     *
+     * @return        True if the level is enabled
+     */
+    template <Levels level>
+    inline bool
+    Do()
+    {
+        if constexpr (level > ASKR_DEBUG_MAX_LEVEL) {
+            return false;
+        } else {
+            return Do(level);
+        }
     }
 
 } // namespace debug
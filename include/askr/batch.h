@@ -0,0 +1,572 @@
+/**
+ * @file
+ * @brief The public include file for the columnar record batch.
+ *
+ * This is a public include file, which plugins are expected to use. A RecordBatch holds all the records parsed
+ * out of one Buffer, in a columnar layout: one Column per (requested) key, with offsets into the Buffer plus a
+ * null bitmap. Filters which only look at one or two keys can then scan a dense column, rather than chasing
+ * through one map per record.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <askr/buffers.h>
+#include <askr/keys.h>
+#include <askr/keyvals.h>
+#include <askr/value.h>
+
+namespace askr
+{
+/**
+ * @brief A byte range within a Buffer. We use 32-bit offsets, since a Buffer chunk is never anywhere near 4GB.
+ */
+struct Span {
+    uint32_t offset = 0;
+    uint32_t length = 0;
+};
+
+/**
+ * @class Projection
+ * @brief The set of keys that the plugins of a script have requested.
+ *
+ * The reader only materializes columns for the keys in the projection, and the tokenizer skips all other fields
+ * entirely. A projection can also be "all", e.g. when an output plugin prints every key of the records; this
+ * does not make the reader materialize any more columns, those fields are tokenized lazily, and only for the
+ * records that are actually presented (see KeyValueStore).
+ */
+class Projection
+{
+public:
+    /**
+     * @brief Request a key.
+     *
+     * @param key   The interned key
+     */
+    void
+    add(KeyId key)
+    {
+        if (!contains(key)) {
+            keys_.push_back(key);
+        }
+    }
+
+    /**
+     * @brief Request a key by name, interning it as necessary.
+     *
+     * @param name  The key name
+     */
+    void
+    add(std::string_view name)
+    {
+        add(askr::keys::intern(name));
+    }
+
+    /**
+     * @brief Request all keys.
+     */
+    void
+    add_all()
+    {
+        all_ = true;
+    }
+
+    /**
+     * @brief Merge another projection into this one.
+     *
+     * @param other  The projection to merge
+     */
+    void
+    merge(const Projection &other)
+    {
+        all_ = all_ || other.all_;
+        for (auto key : other.keys_) {
+            add(key);
+        }
+    }
+
+    /**
+     * @brief Check if a key was requested.
+     *
+     * @param key   The interned key
+     * @return      True if the key was explicitly requested, or all keys are
+     */
+    bool
+    contains(KeyId key) const
+    {
+        if (all_) {
+            return true;
+        }
+        for (auto k : keys_) {
+            if (k == key) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  True if all keys are requested
+     */
+    bool
+    all() const
+    {
+        return all_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The explicitly requested keys, in the order they were requested
+     */
+    const std::vector<KeyId> &
+    keys() const
+    {
+        return keys_;
+    }
+
+private:
+    std::vector<KeyId> keys_;
+    bool all_ = false;
+};
+
+/**
+ * @class Column
+ * @brief All the values of one key, for every record in a RecordBatch.
+ *
+ * The values are Spans into the batch's Buffer. A record which does not have the key is null, which is tracked
+ * in a separate bitmap, such that a null check is just one bit test. The decoded (typed) values are cached in
+ * the column as well, but that cache is only allocated once a value is first used as a number.
+ */
+class Column
+{
+public:
+    Column() = delete;
+
+    /**
+     * @brief Construct a new, empty Column object.
+     *
+     * @param key   The interned key of this column
+     */
+    explicit Column(KeyId key) : key_(key) {}
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The interned key of this column
+     */
+    KeyId
+    key() const
+    {
+        return key_;
+    }
+
+    /**
+     * @brief Check if a record has no value for this column.
+     *
+     * @param row   The record index within the batch
+     * @return      True if the record did not have this key
+     */
+    bool
+    is_null(size_t row) const
+    {
+        return row >= spans_.size() || !((valid_[row >> 6] >> (row & 63)) & 1);
+    }
+
+    /**
+     * @brief Get the raw Span of a value, only meaningful if the value is not null.
+     *
+     * @param row   The record index within the batch
+     * @return      The Span of the value in the Buffer
+     */
+    Span
+    span(size_t row) const
+    {
+        return spans_[row];
+    }
+
+    /**
+     * @brief Simple getter, for code that scans the column directly (e.g. the JIT).
+     *
+     * @return  The Spans of all the values, which can be fewer than the records of the batch
+     */
+    const std::vector<Span> &
+    spans() const
+    {
+        return spans_;
+    }
+
+    /**
+     * @brief Simple getter, for code that scans the column directly (e.g. the JIT).
+     *
+     * @return  The null bitmap, a set bit means the value is present
+     */
+    const std::vector<uint64_t> &
+    valid() const
+    {
+        return valid_;
+    }
+
+    /**
+     * @brief Set the value for a record, growing the column (with nulls) as necessary.
+     *
+     * @param row   The record index within the batch
+     * @param span  The Span of the value in the Buffer
+     */
+    void
+    set(size_t row, Span span)
+    {
+        if (row >= spans_.size()) {
+            spans_.resize(row + 1);
+            valid_.resize((row >> 6) + 1);
+        }
+        spans_[row] = span;
+        valid_[row >> 6] |= uint64_t{1} << (row & 63);
+    }
+
+    /**
+     * @brief Get the decoded value of a record, decoding (and caching) it on first access.
+     *
+     * @param row   The record index within the batch
+     * @param base  The start of the Buffer that the Spans are relative to
+     * @return      The decoded value
+     */
+    const TypedValue &
+    typed(size_t row, const char *base) const
+    {
+        if (row >= typed_.size()) {
+            typed_.resize(row < spans_.size() ? spans_.size() : row + 1);
+        }
+
+        TypedValue &val = typed_[row];
+
+        if (val.type() == TypedValue::UNPARSED) {
+            val = is_null(row) ? TypedValue::parse({}) : TypedValue::parse({base + spans_[row].offset, spans_[row].length});
+        }
+        return val;
+    }
+
+    /**
+     * @brief Remove all values, retaining the allocated memory.
+     */
+    void
+    clear()
+    {
+        spans_.clear();
+        valid_.clear();
+        typed_.clear();
+    }
+
+private:
+    KeyId key_;
+    std::vector<Span> spans_;
+    std::vector<uint64_t> valid_;            /**< The null bitmap, a set bit means the value is present */
+    mutable std::vector<TypedValue> typed_; /**< The decoded values, populated on first access */
+};
+
+/**
+ * @class RecordBatch
+ * @brief All the records parsed out of one Buffer, with one Column per projected key.
+ *
+ * The batch retains the Buffer, such that all Spans (and string_views produced from them) remain valid for as
+ * long as the batch is alive. The batch also carries a selection vector; filters narrow this down to the records
+ * that pass, and the output only presents the selected records. Keys which are not materialized as columns are
+ * still available, through the lazy KeyValueStore of a record.
+ */
+class RecordBatch
+{
+public:
+    /**
+     * @brief The sentinel in the layout() for keys which are not materialized as a column.
+     */
+    static constexpr uint32_t NO_COLUMN = UINT32_MAX;
+
+    RecordBatch() = delete;
+
+    /**
+     * @brief Construct a new RecordBatch object, with an empty column for each of the projected keys.
+     *
+     * @param buffer       The Buffer that the records are parsed out of
+     * @param projection   The keys that should be materialized as columns
+     * @param reader       The Reader producing the records, used to tokenize the fields that are not materialized
+     */
+    RecordBatch(std::shared_ptr<Buffer> buffer, const Projection &projection, const Reader *reader);
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The number of records in the batch (selected or not)
+     */
+    size_t
+    size() const
+    {
+        return records_.size();
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The Buffer holding all the data of this batch
+     */
+    const std::shared_ptr<Buffer> &
+    buffer() const
+    {
+        return buffer_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The keys that the reader should materialize
+     */
+    const Projection &
+    projection() const
+    {
+        return projection_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The sequence number of the batch, in input order. This is what orders the output of batches which
+     *          were filtered on different threads.
+     */
+    uint64_t
+    sequence() const
+    {
+        return sequence_;
+    }
+
+    /**
+     * @brief Simple setter, used by the pipeline as batches are read.
+     *
+     * @param sequence   The sequence number of the batch
+     */
+    void
+    set_sequence(uint64_t sequence)
+    {
+        sequence_ = sequence;
+    }
+
+    /**
+     * @brief Add a new record, used by the readers.
+     *
+     * @param span  The Span of the raw record in the Buffer
+     * @return      The index of the new record
+     */
+    size_t
+    add_record(Span span)
+    {
+        records_.push_back(span);
+        selection_.push_back(static_cast<uint32_t>(records_.size() - 1));
+
+        return records_.size() - 1;
+    }
+
+    /**
+     * @brief Get the raw (unparsed) record.
+     *
+     * @param row   The record index within the batch
+     * @return      The raw record, without the record separator
+     */
+    std::string_view
+    record(size_t row) const
+    {
+        return view(records_[row]);
+    }
+
+    /**
+     * @brief Get the lazy, row oriented, view of a record, with all of its fields.
+     *
+     * @param row   The record index within the batch
+     * @return      The KeyValueStore of the record
+     */
+    KeyValueStore
+    store(size_t row) const
+    {
+        return {buffer_, record(row), reader_};
+    }
+
+    /**
+     * @brief Convert a Span into a string_view into the Buffer of this batch.
+     *
+     * @param span  The Span
+     * @return      The corresponding string_view
+     */
+    std::string_view
+    view(Span span) const
+    {
+        return {buffer_->data() + span.offset, span.length};
+    }
+
+    /**
+     * @brief Find the column for a key.
+     *
+     * @param key   The interned key
+     * @return      The column, or nullptr if the key was not materialized
+     */
+    Column *
+    column(KeyId key)
+    {
+        return (key < index_.size() && index_[key] >= 0) ? &columns_[index_[key]] : nullptr;
+    }
+
+    /**
+     * @brief Find the column for a key.
+     *
+     * @param key   The interned key
+     * @return      The column, or nullptr if the key was not materialized
+     */
+    const Column *
+    column(KeyId key) const
+    {
+        return (key < index_.size() && index_[key] >= 0) ? &columns_[index_[key]] : nullptr;
+    }
+
+    /**
+     * @brief Add a column for a key, if it does not already exist.
+     *
+     * Note that this can invalidate previously returned Column pointers.
+     *
+     * @param key   The interned key
+     * @return      The (possibly new) column
+     */
+    Column &add_column(KeyId key);
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  All the materialized columns, in the order they were added
+     */
+    const std::vector<Column> &
+    columns() const
+    {
+        return columns_;
+    }
+
+    /**
+     * @brief Get the value of a key for a record. Keys that are not materialized are tokenized out of the record.
+     *
+     * @param key   The interned key
+     * @param row   The record index within the batch
+     * @return      The value, or an empty string_view with a nullptr data() if the value is null
+     */
+    std::string_view
+    value(KeyId key, size_t row) const
+    {
+        if (const Column *col = column(key); col) {
+            return col->is_null(row) ? std::string_view{} : view(col->span(row));
+        }
+        return store(row).find(askr::keys::name(key));
+    }
+
+    /**
+     * @brief Check if a value of a record is JSON text rather than a string, see Reader::is_json().
+     *
+     * @param row    The record index within the batch
+     * @param value  The value, from a column or the KeyValueStore of the record
+     * @return       True if the value is JSON text
+     */
+    bool is_json(size_t row, std::string_view value) const;
+
+    /**
+     * @brief Get the decoded value of a key for a record. For materialized keys, this is cached in the column.
+     *
+     * @param key   The interned key
+     * @param row   The record index within the batch
+     * @return      The decoded value, of type TypedValue::NONE if the value is null
+     */
+    TypedValue
+    typed(KeyId key, size_t row) const
+    {
+        if (const Column *col = column(key); col) {
+            return col->typed(row, buffer_->data());
+        }
+        return TypedValue::parse(value(key, row));
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The record indexes that passed all filters so far, in input order
+     */
+    const std::vector<uint32_t> &
+    selection() const
+    {
+        return selection_;
+    }
+
+    /**
+     * @brief Replace the selection vector, used by filters. This must be a subset of the current selection.
+     *
+     * @param selection  The new selection vector, in input order
+     */
+    void
+    select(std::vector<uint32_t> &&selection)
+    {
+        selection_ = std::move(selection);
+    }
+
+    /**
+     * @brief Set the output layout of the batch: which keys to present, and in which order.
+     *
+     * The keys are resolved to column indexes once for the whole batch, producing a permutation over the columns.
+     * The records themselves are never copied or rebuilt. Keys without a column get the NO_COLUMN sentinel.
+     *
+     * @param keys  The keys to present, in order. This is typically a fixed plan shared by all batches.
+     */
+    void set_layout(std::shared_ptr<const std::vector<KeyId>> keys);
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The keys to present, in order, or nullptr if all fields of the records are presented in input order
+     */
+    const std::vector<KeyId> *
+    layout_keys() const
+    {
+        return layout_keys_.get();
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The column index for each of the layout_keys(), or NO_COLUMN
+     */
+    const std::vector<uint32_t> &
+    layout() const
+    {
+        return layout_;
+    }
+
+private:
+    std::shared_ptr<Buffer> buffer_;
+    Projection projection_;
+    const Reader *reader_;
+    uint64_t sequence_ = 0;
+    std::shared_ptr<const std::vector<KeyId>> layout_keys_;
+    std::vector<uint32_t> layout_;
+    std::vector<Span> records_;
+    std::vector<uint32_t> selection_;
+    std::vector<Column> columns_;
+    std::vector<int32_t> index_; /**< Dense KeyId -> columns_ index, -1 for no column */
+};
+} // namespace askr
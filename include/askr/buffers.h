@@ -20,13 +20,323 @@
  */
 #pragma once
 
-#include <string>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
 
 namespace askr
 {
+class BufferPool;
+
+/**
+ * @class Buffer
+ * @brief One chunk of raw input data, handed out by a BufferPool.
+ *
+ * The Buffer does not own its memory, it borrows a chunk from the pool and returns it when destroyed. All
+ * std::string_view's produced by the readers point into a Buffer, so it is always passed around as a
+ * std::shared_ptr, keeping the chunk alive for as long as any record refers to it.
+ *
+ * A reader which decodes values, e.g. unescapes strings, can have space set aside at the end of the chunk for
+ * them (see reserve()). Decoded values in that space are addressed by Spans just like the input. The Buffer also
+ * carries the reader's state for its records, which the lazy tokenizer (Reader::next_field()) needs.
+ */
 class Buffer
 {
+public:
+    Buffer() = delete;
+    Buffer(const Buffer &) = delete;
+    Buffer &operator=(const Buffer &) = delete;
+
+    /**
+     * @brief Construct a new Buffer object around a pool chunk. This is only used by the BufferPool.
+     *
+     * @param pool       The pool that owns the chunk memory
+     * @param data       The start of the chunk
+     * @param capacity   The size of the chunk, in bytes
+     */
+    Buffer(BufferPool *pool, char *data, size_t capacity)
+        : pool_(pool), data_(data), capacity_(capacity), end_(capacity), scratch_(capacity)
+    {
+    }
+
+    /**
+     * @brief Destroy the Buffer object, which releases the chunk back to the pool.
+     */
+    ~Buffer();
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  Pointer to the start of the chunk
+     */
+    char *
+    data()
+    {
+        return data_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  Pointer to the start of the chunk
+     */
+    const char *
+    data() const
+    {
+        return data_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The number of valid bytes in the chunk
+     */
+    size_t
+    size() const
+    {
+        return size_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The total size of the chunk, in bytes
+     */
+    size_t
+    capacity() const
+    {
+        return capacity_;
+    }
+
+    /**
+     * @brief Set the number of valid bytes in the chunk, typically after a read() into data().
+     *
+     * @param size   The number of valid bytes, must not exceed the capacity
+     */
+    void
+    set_size(size_t size)
+    {
+        size_ = size < capacity_ ? size : capacity_;
+    }
+
+    /**
+     * @brief Set aside space at the end of the chunk, for the values that the reader decodes (see scratch()). This
+     *        reduces the capacity for the input, so it must be done before reading into the Buffer.
+     *
+     * @param bytes   The space to set aside, at most the capacity
+     */
+    void
+    reserve(size_t bytes)
+    {
+        capacity_ = end_ - (bytes < end_ ? bytes : end_);
+        scratch_  = capacity_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The space that is left for scratch()
+     */
+    size_t
+    reserved() const
+    {
+        return end_ - scratch_;
+    }
+
+    /**
+     * @brief Get space for a decoded value, out of the space set aside with reserve(). Only the reader uses this,
+     *        while parsing, and the space is only taken by commit(). A Span can refer to the value.
+     *
+     * @param len   The most bytes the value needs
+     * @return      The space, or nullptr if there's not enough left
+     */
+    char *
+    scratch(size_t len)
+    {
+        return len <= end_ - scratch_ ? data_ + scratch_ : nullptr;
+    }
+
+    /**
+     * @brief Take the space of a decoded value, which was written to scratch().
+     *
+     * @param len   The length of the value
+     */
+    void
+    commit(size_t len)
+    {
+        scratch_ += len;
+    }
+
+    /**
+     * @brief Allocate memory for a value decoded by the lazy tokenizer, which lives as long as the Buffer. This is
+     *        taken from the scratch() space while there is some, and from the heap after that, so a Span can not
+     *        necessarily refer to it. The Buffer is only used by one thread at a time, so this is not locked.
+     *
+     * @param len   The bytes to allocate
+     * @return      The memory
+     */
+    char *allocate(size_t len);
+
+    /**
+     * @brief Attach the reader's state for the records of this Buffer, e.g. the fields of a log format which a
+     *        directive in the input can change. The state is retained by the Buffer.
+     *
+     * @param state   The state, specific to the reader
+     */
+    void
+    set_state(std::shared_ptr<const void> state)
+    {
+        state_ = std::move(state);
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The reader's state, or nullptr if none was attached
+     */
+    const void *
+    state() const
+    {
+        return state_.get();
+    }
+
+    /**
+     * @brief Get a view of the valid bytes in the chunk.
+     *
+     * @return  A std::string_view of [data(), data() + size())
+     */
+    std::string_view
+    view() const
+    {
+        return {data_, size_};
+    }
+
+private:
+    BufferPool *pool_;
+    char *data_;
+    size_t capacity_;
+    size_t end_;     /**< The size of the chunk, the capacity is less with a reserve() */
+    size_t scratch_; /**< The start of the free scratch() space, at end_ if none is left */
+    size_t size_ = 0;
+    std::shared_ptr<const void> state_;
+    std::vector<std::unique_ptr<char[]>> allocated_; /**< What allocate() took from the heap */
+};
+
+/**
+ * @class BufferPool
+ * @brief A fixed size pool of equally sized Buffer chunks, carved out of one large memory mapping.
+ *
+ * The parsing threads scan through large amounts of memory, so the mapping is backed by 2MB huge pages when
+ * possible, to keep the dTLB misses down. We first try an explicit MAP_HUGETLB mapping, and if the system
+ * has no (or not enough) huge pages reserved, we fall back to a regular mapping with madvise(MADV_HUGEPAGE),
+ * such that transparent huge pages can back it. On platforms without either, this is just a regular mapping.
+ */
+class BufferPool
+{
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;     /**< The huge page size we align to */
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 4 * 1024 * 1024; /**< Default size of each Buffer chunk */
+    static constexpr size_t DEFAULT_NUM_CHUNKS = 16;              /**< Default number of chunks in the pool */
+
+    BufferPool() = delete;
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    /**
+     * @brief Construct a new BufferPool object, mapping all the memory for the chunks up front.
+     *
+     * This throws a std::system_error if the memory can not be mapped at all.
+     *
+     * @param chunk_size   The size of each chunk, rounded up to a multiple of the huge page size
+     * @param num_chunks   The number of chunks in the pool
+     * @param prefault     Touch all pages up front, such that no page faults happen while parsing
+     */
+    BufferPool(size_t chunk_size, size_t num_chunks, bool prefault = false);
+
+    /**
+     * @brief Destroy the BufferPool object, and unmap all of its memory. All Buffers must be released before this.
+     */
+    ~BufferPool();
+
+    /**
+     * @brief Get a chunk from the pool. The chunks are the credits of the reader: waiting for one to be released
+     *        is what holds the reader back when the rest of the pipeline can't keep up.
+     *
+     * @param wait   Wait for a chunk to be released if the pool is exhausted
+     * @return       A shared pointer to the Buffer, or an empty pointer if the pool is exhausted and not waiting
+     */
+    std::shared_ptr<Buffer> acquire(bool wait = false);
+
+    /**
+     * @brief Touch every page of the pool, forcing the kernel to back the entire mapping right away.
+     */
+    void prefault();
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The size of each chunk, in bytes
+     */
+    size_t
+    chunk_size() const
+    {
+        return chunk_size_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The number of chunks in the pool
+     */
+    size_t
+    num_chunks() const
+    {
+        return num_chunks_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The number of chunks currently available for acquire()
+     */
+    size_t available() const;
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The most chunks that were in use at any one time
+     */
+    size_t peak() const;
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  True if the pool got explicit (MAP_HUGETLB) huge pages
+     */
+    bool
+    hugetlb() const
+    {
+        return hugetlb_;
+    }
+
 private:
-    std::string buf_;
+    friend class Buffer;
+
+    void release(char *chunk);
+
+    size_t chunk_size_;
+    size_t num_chunks_;
+    size_t mapped_size_ = 0;  /**< Total size of the mapping, which can include alignment slack */
+    char *mapping_ = nullptr; /**< Start of the mapping, as returned by mmap() */
+    char *base_ = nullptr;    /**< First chunk, aligned on a huge page boundary */
+    bool hugetlb_ = false;
+    size_t peak_  = 0;        /**< The most chunks in use at once */
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<char *> free_;
 };
 } // namespace askr
@@ -0,0 +1,73 @@
+/**
+ * @file
+ * @brief The public include file for the interned keys.
+ *
+ * This is a public include file, which plugins are expected to use. Every key name that the script, or a plugin,
+ * refers to is interned once into a small, dense integer (KeyId). This allows all the hot paths to identify
+ * keys (e.g. columns in a RecordBatch) without any string comparisons.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace askr
+{
+/**
+ * @brief The interned identifier of a key, these are allocated densely starting at 0.
+ */
+using KeyId = uint32_t;
+
+/**
+ * @brief The KeyId used for "no such key".
+ */
+static constexpr KeyId INVALID_KEY = UINT32_MAX;
+
+namespace keys
+{
+    /**
+     * @brief Intern a key name, allocating a new KeyId if this is the first time we see it.
+     *
+     * @param name   The key name, this is copied into the registry
+     * @return       The KeyId for the name
+     */
+    KeyId intern(std::string_view name);
+
+    /**
+     * @brief Lookup a key name, without interning it.
+     *
+     * @param name   The key name
+     * @return       The KeyId for the name, or INVALID_KEY if it has never been interned
+     */
+    KeyId find(std::string_view name);
+
+    /**
+     * @brief Get the name of an interned key.
+     *
+     * @param id     The KeyId
+     * @return       The name of the key, this view is valid for the life time of the process
+     */
+    std::string_view name(KeyId id);
+
+    /**
+     * @brief Get the number of interned keys, which is also the upper (exclusive) bound for all KeyId's.
+     *
+     * @return       The number of interned keys
+     */
+    size_t size();
+} // namespace keys
+} // namespace askr
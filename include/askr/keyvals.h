@@ -21,35 +21,106 @@
 
 #include <memory>
 #include <string_view>
+#include <utility>
 #include <vector>
-#include <unordered_map>
 
 #include <askr/buffers.h>
+#include <askr/value.h>
 
 namespace askr
 {
+class Reader;
+
+/**
+ * @brief One key-value pair of a record, both views are into the record's Buffer.
+ */
+using Field = std::pair<std::string_view, std::string_view>;
+
 /**
  * @brief A container which gets populated, and passed along, extensively through records processing
  *
  * This is a public class, that plugins will rely on extensively. It manages the memory itself, so it's
  * important to retain it's shared-ptr semantics through all plugins. The store can iterate over the
- * key-values in the order which they were added, essentially preversing the input order.
+ * key-values in the order which they appear in the record, essentially preserving the input order.
  *
- * We have sub-classed std::unordered map here, to allow us to use it mostly as-is, but overloading
- * certain methods and operators such that we can retain order.
+ * The store is lazy: it is created with just the raw record, and fields are tokenized (by the Reader that
+ * produced the record) only as they are accessed. A find() stops tokenizing as soon as the key is found, and
+ * later lookups resume where the previous one stopped. For wide records where the script only uses a few
+ * keys, most of the record is never tokenized at all.
  *
  * Important: A KeyValueStore is intended to contain exactly one (1) record! This is important for
  * memory management: This assures that all std::string_views in the key-val store are all from the
  * same memory blob. One such blob can of course be used for multiple key-val stores, but one key-val
  * store can belong to one, and exactly one, blob.
  */
-class KeyValueStore : public std::unordered_map<std::string_view, const std::string_view>
+class KeyValueStore
 {
+public:
     KeyValueStore() = delete;
-    KeyValueStore(askr::Buffer *) {}
+
+    /**
+     * @brief Construct a new KeyValueStore object, for one raw record.
+     *
+     * @param buffer   The Buffer that the record lives in, this is retained by the store
+     * @param record   The raw record, without the record separator
+     * @param reader   The Reader which tokenizes the fields of the record
+     */
+    KeyValueStore(std::shared_ptr<Buffer> buffer, std::string_view record, const Reader *reader)
+        : buffer_(std::move(buffer)), record_(record), reader_(reader)
+    {
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The raw record
+     */
+    std::string_view
+    record() const
+    {
+        return record_;
+    }
+
+    /**
+     * @brief Find the value of a key, tokenizing only as much of the record as necessary.
+     *
+     * @param key   The key name
+     * @return      The value, or an empty string_view with a nullptr data() if the record has no such key
+     */
+    std::string_view find(std::string_view key) const;
+
+    /**
+     * @brief Find the decoded value of a key, decoding (and caching) it on first access.
+     *
+     * @param key   The key name
+     * @return      The decoded value, of type TypedValue::NONE if the record has no such key
+     */
+    TypedValue typed(std::string_view key) const;
+
+    /**
+     * @brief Get all fields of the record, in input order. This tokenizes the remainder of the record.
+     *
+     * @return      All the key-value pairs of the record
+     */
+    const std::vector<Field> &fields() const;
+
+    /**
+     * @brief Check if a value of the record is JSON text rather than a string, see Reader::is_json().
+     *
+     * @param value  The value, as returned by find() or fields()
+     * @return       True if the value is JSON text
+     */
+    bool is_json(std::string_view value) const;
 
 private:
-    std::vector<std::string_view> _order;
-    std::shared_ptr<askr::Buffer> _buffer;
+    bool next() const;
+    size_t index(std::string_view key) const;
+
+    std::shared_ptr<Buffer> buffer_;
+    std::string_view record_;
+    const Reader *reader_;
+    mutable std::vector<Field> fields_;      /**< The fields tokenized so far, in input order */
+    mutable std::vector<TypedValue> typed_; /**< The decoded values of the fields, populated on first access */
+    mutable size_t pos_ = 0;                 /**< Where the tokenizer resumes, std::string_view::npos when done */
 };
 } // namespace askr
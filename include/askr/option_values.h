@@ -0,0 +1,73 @@
+/**
+ * @file
+ * @brief The public include file for the command line option values.
+ *
+ * This is a public include file, plugins use this to get the values of the script specific command line options
+ * that they have been configured to use (e.g. selector.so's "option: selKeys").
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace askr
+{
+/**
+ * @class OptionValues
+ * @brief Holds one, or more, values associated with a specific option
+ *
+ * Each stored option is a vector of strings. We always split the options on ',', as well as
+ * multiple invocation of an option.
+ */
+class OptionValues
+{
+public:
+    /**
+     * @brief Parse and add element(s) to the vector for the provided option (key)
+     *
+     * @param key The option name, which is the key into the hash
+     * @param str The string, possibly comma separated, to parse and add.
+     * @return true  On success
+     * @return false If any error during parsing / addition occured
+     */
+    bool add(const std::string &key, const std::string &str);
+
+    /**
+     * @brief Simple getter
+     *
+     * @param key The option name, which is the key into the hash
+     * @return The vector of value string values (possibly empty)
+     */
+    const std::vector<std::string> &get(const std::string &key) const;
+
+    /**
+     * @brief Simple getter
+     *
+     * @param key The option name, which is the key into the hash
+     * @return The vector of value string values (possibly empty)
+     */
+    const std::vector<std::string> &
+    get(const char *key) const
+    {
+        return get(std::string{key});
+    }
+
+private:
+    std::unordered_map<std::string, std::vector<std::string>> options_;
+};
+
+} // namespace askr
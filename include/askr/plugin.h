@@ -0,0 +1,225 @@
+/**
+ * @file
+ * @brief The public include file for the plugin interfaces.
+ *
+ * This is a public include file, which every plugin must use. A plugin is a shared object, which implements
+ * exactly one of the Reader, Filter or Output interfaces, and exports the factory function through the
+ * ASKR_PLUGIN() macro, e.g.
+ *
+ *     class CsvReader : public askr::Reader { ... };
+ *     ASKR_PLUGIN(CsvReader)
+ *
+ * The bundled plugins can also be linked into the askr binary (configure --enable-static-plugins), which lets the
+ * compiler optimize across the reader, filters and output. Shared object plugins still load as usual.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <yaml-cpp/yaml.h>
+
+#include <askr/askr.h>
+#include <askr/batch.h>
+#include <askr/option_values.h>
+#include <askr/sink.h>
+
+namespace askr
+{
+/**
+ * @class Plugin
+ * @brief The common base class for all plugins.
+ */
+class Plugin
+{
+public:
+    virtual ~Plugin();
+
+    /**
+     * @brief Configure the plugin, from its YAML node in the script. Errors are reported by throwing.
+     *
+     * @param node     The YAML node for this plugin, e.g. {plugin: csv_reader.so, configs: {...}}
+     * @param values   The values of all the script specific command line options
+     */
+    virtual void setup(const YAML::Node &node, const OptionValues &values);
+
+    /**
+     * @brief Add the keys this plugin needs to the projection. This is called after setup().
+     *
+     * The reader only materializes the requested keys as columns, and skips all other fields. The default is
+     * to request nothing.
+     *
+     * @param projection   The projection to add keys to
+     */
+    virtual void columns(Projection &projection) const;
+};
+
+/**
+ * @class Reader
+ * @brief The interface for input plugins, which tokenize the raw data of a Buffer into a RecordBatch.
+ */
+class Reader : public Plugin
+{
+public:
+    ~Reader() override;
+
+    /**
+     * @brief Parse all complete records out of the batch's Buffer.
+     *
+     * @param batch    The batch to add records to, its Buffer holds the raw data
+     * @param eof      True if this is the last data of the input, i.e. a trailing record has no separator
+     * @return         The number of bytes consumed, the remainder is carried over to the next Buffer
+     */
+    virtual size_t parse(RecordBatch &batch, bool eof) = 0;
+
+    /**
+     * @brief The space to set aside at the end of every Buffer, for the values that the reader decodes (see
+     * Buffer::reserve()). The input is read into the rest of the Buffer. The default is none.
+     *
+     * @param capacity The capacity of the Buffer
+     * @return         The bytes to set aside
+     */
+    virtual size_t reserve(size_t capacity) const;
+
+    /**
+     * @brief Check if a value of a record is JSON text (e.g. a number, a literal or a nested object) which an
+     * output can present as it is. All other values are strings. The default is that no value is JSON text.
+     *
+     * @param record   The raw record, as added to the RecordBatch by parse()
+     * @param value    The value, as set in a column by parse() or by next_field()
+     * @return         True if the value is JSON text
+     */
+    virtual bool is_json(std::string_view record, std::string_view value) const;
+
+    /**
+     * @brief Tokenize the next field of a raw record, this is used for lazy materialization of the keys which
+     * are not in the projection (see KeyValueStore).
+     *
+     * @param buffer   The Buffer of the record, with the reader's state for it, and for allocating decoded values
+     * @param record   The raw record, as added to the RecordBatch by parse()
+     * @param pos      The position to start at, 0 for the first field
+     * @param key      Set to the key of the field, or left with a nullptr data() if the text was not a field
+     * @param value    Set to the value of the field
+     * @return         The position of the next field, or std::string_view::npos if there are no more fields
+     */
+    virtual size_t next_field(Buffer &buffer, std::string_view record, size_t pos, std::string_view &key,
+                              std::string_view &value) const = 0;
+};
+
+/**
+ * @class Filter
+ * @brief The interface for filter plugins, which narrow down the selection of a RecordBatch.
+ */
+class Filter : public Plugin
+{
+public:
+    ~Filter() override;
+
+    /**
+     * @brief Process a batch, typically by replacing its selection vector.
+     *
+     * @param batch    The batch to filter
+     */
+    virtual void process(RecordBatch &batch) = 0;
+};
+
+/**
+ * @class Output
+ * @brief The interface for output plugins, which present the selected records of a RecordBatch.
+ *
+ * With multiple threads, each thread has its own instances of the filters and the output, so an output plugin
+ * never sees concurrent calls. The batches are however not seen in input order.
+ */
+class Output : public Plugin
+{
+public:
+    ~Output() override;
+
+    /**
+     * @brief Present all the selected records of a batch.
+     *
+     * @param batch    The batch to present
+     */
+    virtual void output(const RecordBatch &batch) = 0;
+
+    /**
+     * @brief Flush any pending output, this is called once all input has been processed.
+     */
+    virtual void flush();
+
+    /**
+     * @brief Attach the buffer that the output is rendered into, this is done by the pipeline before each call
+     * to output() and flush(). The pipeline writes the rendered buffers in input order.
+     *
+     * @param out    The OutputBuffer for the current batch
+     */
+    void
+    attach(OutputBuffer *out)
+    {
+        out_ = out;
+    }
+
+protected:
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The OutputBuffer to render the current batch into
+     */
+    OutputBuffer &
+    out()
+    {
+        return *out_;
+    }
+
+private:
+    OutputBuffer *out_ = nullptr;
+};
+
+/**
+ * @brief The signature of the factory function that every plugin exports.
+ */
+using PluginFactory = Plugin *(*)();
+
+/**
+ * @brief Register a plugin which is linked into the askr binary, this is done by ASKR_PLUGIN() for static builds.
+ *
+ * @param file      The source file of the plugin, which names it, e.g. "plugins/csv_reader.cc" is "csv_reader.so"
+ * @param factory   The factory function of the plugin
+ * @return          Always true, such that the registration can initialize a static
+ */
+bool register_static_plugin(const char *file, PluginFactory factory);
+
+/**
+ * @brief Find a plugin which is linked into the askr binary.
+ *
+ * @param name   The name of the plugin, as used in the scripts, e.g. "csv_reader.so"
+ * @return       The factory function, or nullptr if there is no such plugin linked in
+ */
+PluginFactory find_static_plugin(const std::string &name);
+} // namespace askr
+
+/**
+ * @brief Export the factory function for a plugin class. Use this exactly once per plugin. When the plugin is
+ * linked into the askr binary (ASKR_STATIC_PLUGINS), it is instead registered at startup, named by its source file.
+ */
+#if defined(ASKR_STATIC_PLUGINS)
+#define ASKR_PLUGIN(CLASS)                                         \
+    [[maybe_unused]] static const bool askr_plugin_registered_ = \
+        askr::register_static_plugin(__FILE__, []() -> askr::Plugin * { return new CLASS(); });
+#else
+#define ASKR_PLUGIN(CLASS)                        \
+    extern "C" askr::Plugin *askr_plugin_create() \
+    {                                             \
+        return new CLASS();                       \
+    }
+#endif
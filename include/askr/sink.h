@@ -0,0 +1,259 @@
+/**
+ * @file
+ * @brief The public include file for the output sink.
+ *
+ * This is a public include file, which output plugins are expected to use. Output plugins render each batch
+ * into an OutputBuffer, which the pipeline then writes, in input order, to the Sink. Nothing is written through
+ * iostreams or individual write()'s.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <thread>
+
+namespace askr
+{
+/**
+ * @class OutputBuffer
+ * @brief A growable buffer, which an output plugin renders one batch into.
+ */
+class OutputBuffer
+{
+public:
+    static constexpr size_t INITIAL_SIZE = 256 * 1024; /**< The initial allocation, grown as needed */
+
+    /**
+     * @brief Append bytes to the buffer.
+     *
+     * @param data   The bytes to append
+     * @param len    The number of bytes
+     */
+    void
+    append(const char *data, size_t len)
+    {
+        if (size_ + len > capacity_) {
+            grow(size_ + len);
+        }
+        if (len > 0) {
+            memcpy(data_.get() + size_, data, len);
+            size_ += len;
+        }
+    }
+
+    /**
+     * @brief Append a string to the buffer.
+     *
+     * @param str    The string to append
+     */
+    void
+    append(std::string_view str)
+    {
+        append(str.data(), str.size());
+    }
+
+    /**
+     * @brief Reserve space in the buffer, for rendering directly into it. Follow up with commit().
+     *
+     * @param len    The number of bytes needed
+     * @return       Pointer to at least len bytes of space
+     */
+    char *
+    reserve(size_t len)
+    {
+        if (size_ + len > capacity_) {
+            grow(size_ + len);
+        }
+        return data_.get() + size_;
+    }
+
+    /**
+     * @brief Commit bytes rendered into the space returned by reserve().
+     *
+     * @param len    The number of bytes rendered
+     */
+    void
+    commit(size_t len)
+    {
+        size_ += len;
+    }
+
+    /**
+     * @brief Empty the buffer, keeping its allocation for the next batch.
+     */
+    void
+    clear()
+    {
+        size_ = 0;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The rendered bytes
+     */
+    const char *
+    data() const
+    {
+        return data_.get();
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The number of rendered bytes
+     */
+    size_t
+    size() const
+    {
+        return size_;
+    }
+
+private:
+    void grow(size_t needed);
+
+    std::unique_ptr<char[]> data_;
+    size_t size_     = 0;
+    size_t capacity_ = 0;
+};
+
+/**
+ * @class Sink
+ * @brief A double buffered output, written asynchronously on a dedicated thread.
+ *
+ * Rendered bytes are accumulated into large blocks (1-8MB). When a block is full, it is handed to the writer
+ * thread, and rendering continues into the next block. When the output is a pipe, the pipe is resized to the
+ * block size (F_SETPIPE_SZ), and the blocks are vmsplice()'d into the pipe rather than copied. The pipe then
+ * refers to the pages of a spliced block, until another block's worth of output has gone into the pipe. Hence
+ * the third block: one being rendered, one being written, and one possibly still in the pipe. A block which
+ * could still be in the pipe (after a flush() of a partial block) is replaced with fresh pages before reuse.
+ */
+class Sink
+{
+public:
+    static constexpr size_t MIN_BLOCK_SIZE = 1024 * 1024;     /**< The smallest block size */
+    static constexpr size_t MAX_BLOCK_SIZE = 8 * 1024 * 1024; /**< The largest block size */
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 4 * 1024 * 1024;
+    static constexpr size_t NUM_BLOCKS         = 3;
+
+    Sink() = delete;
+    Sink(const Sink &) = delete;
+    Sink &operator=(const Sink &) = delete;
+
+    /**
+     * @brief Construct a new Sink object, and start the writer thread.
+     *
+     * @param fd           The file descriptor to write to, this is not closed by the Sink
+     * @param block_size   The size of each block, adjusted to the pipe capacity for pipes
+     */
+    explicit Sink(int fd, size_t block_size = DEFAULT_BLOCK_SIZE);
+
+    /**
+     * @brief Destroy the Sink object, writing any pending output and stopping the writer thread.
+     */
+    ~Sink();
+
+    /**
+     * @brief Append bytes to the output.
+     *
+     * @param data   The bytes to append
+     * @param len    The number of bytes
+     */
+    void
+    append(const char *data, size_t len)
+    {
+        if (used_ + len <= size_) {
+            if (len > 0) {
+                memcpy(current_ + used_, data, len);
+                used_ += len;
+            }
+        } else {
+            append_slow(data, len);
+        }
+    }
+
+    /**
+     * @brief Append a string to the output.
+     *
+     * @param str    The string to append
+     */
+    void
+    append(std::string_view str)
+    {
+        append(str.data(), str.size());
+    }
+
+    /**
+     * @brief Write all output so far, and wait for it to complete. Any write errors are thrown from here.
+     */
+    void flush();
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The size of each block
+     */
+    size_t
+    block_size() const
+    {
+        return size_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  True if the blocks are vmsplice()'d into a pipe
+     */
+    bool
+    splicing() const
+    {
+        return splice_;
+    }
+
+private:
+    void append_slow(const char *data, size_t len);
+    void submit();
+    void wait_idle(std::unique_lock<std::mutex> &lock);
+    void writer();
+    void write_block(const char *data, size_t len);
+    void remap(size_t ix);
+
+    int fd_;
+    size_t size_;
+    bool splice_ = false;
+
+    char *blocks_[NUM_BLOCKS] = {};
+    size_t block_             = 0; /**< The index of the current block */
+    char *current_            = nullptr;
+    size_t used_              = 0;
+
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    const char *pending_         = nullptr; /**< The block handed to the writer thread, if any */
+    size_t pending_ix_           = 0;
+    size_t pending_len_          = 0;
+    size_t written_              = 0;  /**< Total number of bytes written */
+    size_t released_[NUM_BLOCKS] = {}; /**< The written_ at which a spliced block is no longer in the pipe */
+    bool done_                   = false;
+    std::exception_ptr error_;
+    std::thread thread_;
+};
+} // namespace askr
@@ -0,0 +1,187 @@
+/**
+ * @file
+ * @brief The public include file for the typed (decoded) values.
+ *
+ * This is a public include file, which plugins are expected to use. Many stages interpret the same field as a
+ * number (e.g. "-e bytes>1000000", ordering on a time stamp, aggregations). The decoded value is cached next to
+ * the raw value the first time it is needed, such that the same digits are never parsed twice.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+namespace askr
+{
+/**
+ * @class TypedValue
+ * @brief The decoded value of a field; an integer, a floating point number, a time stamp, or none of those.
+ *
+ * Time stamps are ISO 8601 / RFC 3339 formatted strings (e.g. "2020-02-29T12:34:56.789Z"), or Common Log
+ * Format time stamps (e.g. "10/Oct/2000:13:55:36 -0700"), stored as microseconds since the epoch. When compared
+ * to the other numeric types, a time stamp is in seconds.
+ */
+class TypedValue
+{
+public:
+    /**
+     * @brief The types a value can decode to.
+     */
+    enum Type : uint8_t {
+        UNPARSED,  ///< Not yet decoded, this is only used by the caches
+        NONE,      ///< The value does not exist (null)
+        STRING,    ///< The value exists, but is not a number
+        INTEGER,   ///< A 64-bit signed integer
+        FLOAT,     ///< A double precision floating point number
+        TIMESTAMP, ///< A time stamp, in microseconds since the epoch
+    };
+
+    TypedValue() = default;
+
+    /**
+     * @brief Decode a raw value.
+     *
+     * @param str   The raw value, a nullptr data() means the value does not exist
+     * @return      The decoded value
+     */
+    static TypedValue parse(std::string_view str);
+
+    /**
+     * @brief Construct an INTEGER value.
+     */
+    static TypedValue
+    integer(int64_t val)
+    {
+        TypedValue res;
+
+        res.type_    = INTEGER;
+        res.integer_ = val;
+        return res;
+    }
+
+    /**
+     * @brief Construct a FLOAT value.
+     */
+    static TypedValue
+    floating(double val)
+    {
+        TypedValue res;
+
+        res.type_  = FLOAT;
+        res.float_ = val;
+        return res;
+    }
+
+    /**
+     * @brief Construct a TIMESTAMP value.
+     */
+    static TypedValue
+    timestamp(int64_t usec)
+    {
+        TypedValue res;
+
+        res.type_    = TIMESTAMP;
+        res.integer_ = usec;
+        return res;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The type of the value
+     */
+    Type
+    type() const
+    {
+        return type_;
+    }
+
+    /**
+     * @brief Check if the value is numeric, i.e. if it can be compared as a number.
+     *
+     * @return  True for integers, floating point numbers and time stamps
+     */
+    bool
+    is_number() const
+    {
+        return type_ >= INTEGER;
+    }
+
+    /**
+     * @brief Get the value as an integer. Floating point numbers are truncated, time stamps are in microseconds.
+     *
+     * @return  The integer value, 0 if the value is not numeric
+     */
+    int64_t
+    as_integer() const
+    {
+        return type_ == FLOAT ? static_cast<int64_t>(float_) : (type_ >= INTEGER ? integer_ : 0);
+    }
+
+    /**
+     * @brief Get the value as a double. Time stamps are in seconds (with fractions).
+     *
+     * @return  The double value, 0.0 if the value is not numeric
+     */
+    double
+    as_double() const
+    {
+        switch (type_) {
+        case INTEGER:
+            return static_cast<double>(integer_);
+        case FLOAT:
+            return float_;
+        case TIMESTAMP:
+            return static_cast<double>(integer_) / 1000000.0;
+        default:
+            return 0.0;
+        }
+    }
+
+    /**
+     * @brief The result of compare() when either value is NaN, which is neither less, equal nor greater.
+     */
+    static constexpr int UNORDERED = 2;
+
+    /**
+     * @brief Three-way comparison of two numeric values. Integers of the same type are compared exactly.
+     *
+     * @param other  The value to compare to, both values must be numeric
+     * @return       Less than, equal to or greater than 0, or UNORDERED
+     */
+    int
+    compare(const TypedValue &other) const
+    {
+        if (type_ == other.type_ && type_ != FLOAT) {
+            return (integer_ > other.integer_) - (integer_ < other.integer_);
+        }
+
+        double lhs = as_double(), rhs = other.as_double();
+
+        if (lhs != lhs || rhs != rhs) {
+            return UNORDERED;
+        }
+        return (lhs > rhs) - (lhs < rhs);
+    }
+
+private:
+    union {
+        int64_t integer_ = 0;
+        double float_;
+    };
+    Type type_ = UNPARSED;
+};
+} // namespace askr
@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# Train an instrumented askr, for make pgo. This generates a corpus of each format (once), and runs the training
+# scripts over it, exercising the readers, the -e expressions, the filters and the outputs.
+#
+#  Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+#  file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+#  file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+#  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+#  specific language governing permissions and limitations under the License.
+#
+# Usage: train.sh <top build dir> <profile dir> <corpus dir>
+#
+set -e
+
+builddir=$1
+profdir=$2
+corpus=$3
+scripts=$(cd "$(dirname "$0")" && pwd)
+lines=${PGO_LINES:-500000}
+
+askr=$builddir/src/askr
+export ASKR_PLUGIN_DIR=$builddir/plugins/.libs
+
+mkdir -p "$corpus"
+for format in kv clf json syslog; do
+    if [ ! -s "$corpus/$format.log" ]; then
+        echo "pgo: generating $lines lines of $format"
+        "$builddir/tools/askr-gen" -f $format -n "$lines" > "$corpus/$format.log"
+    fi
+done
+
+run() {
+    echo "pgo: askr $*"
+    "$askr" "$@" > /dev/null
+}
+
+# grep: selective and broad queries, string and numeric conditions
+run "$scripts/kv.yaml" -e status=500 -s time,client,url "$corpus/kv.log"
+run "$scripts/kv.yaml" -e "status>=300" -e "method!=GET" "$corpus/kv.log"
+run "$scripts/kv.yaml" -e "duration>2.5" -e "time>=2020-01-02T00:00:00Z" -s time,url,duration "$corpus/kv.log"
+run "$scripts/clf.yaml" -e "status>=400" -s client,url,status "$corpus/clf.log"
+run "$scripts/pattern.yaml" -e "bytes<1000" -s client,status,url "$corpus/clf.log"
+run "$scripts/json.yaml" -e "request.method=POST" -s time,request.url,status "$corpus/json.log"
+run "$scripts/syslog.yaml" -e "req@32473.status=500" -s time,host,app,msg "$corpus/syslog.log"
+
+# Full records, through the lazy tokenizers, and rendered on worker threads
+run "$scripts/kv.yaml" -t 2 "$corpus/kv.log"
+run "$scripts/clf.yaml" -o json.so "$corpus/clf.log"
+run "$scripts/json.yaml" -t 2 "$corpus/json.log"
+run "$scripts/syslog.yaml" -o json.so "$corpus/syslog.log"
+
+# Merging several inputs into one output
+run "$scripts/kv.yaml" -t 2 -e "status!=200" -s time,status "$corpus/kv.log" "$corpus/kv.log" "$corpus/kv.log"
+
+# clang writes raw profiles, which have to be merged before they can be used
+if ls "$profdir"/*.profraw > /dev/null 2>&1; then
+    ${LLVM_PROFDATA:-llvm-profdata} merge -output="$profdir/default.profdata" "$profdir"/*.profraw
+fi
@@ -0,0 +1,470 @@
+/**
+ * @file
+ * @brief An input plugin, for the Common / Combined Log Formats, and the W3C Extended Log File Format
+ *
+ *     - plugin: clf_reader.so
+ *       configs:
+ *         format: combined
+ *
+ * The formats are "common", "combined" (the default) and "w3c". The Common Log Format fields are client, ident,
+ * user, time, request, method, url, protocol, status and bytes, where method, url and protocol are the parts of
+ * the request line. The Combined Log Format adds referer and agent. For W3C, the fields are named by the most
+ * recent #Fields: directive, e.g. "c-ip" or "cs-method". A value of "-" means the field is not present. The
+ * quoted fields, and the parts of the request line, are decoded if they have escapes: \" and \\, \b, \n, \r, \t
+ * and \v, and \xhh, as Apache's mod_log_config and nginx write them.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <askr/plugin.h>
+
+namespace
+{
+  /**
+   * @brief How each field of a line is delimited.
+   */
+  enum class Kind : uint8_t {
+    WORD,     ///< Up to the next space
+    BRACKET,  ///< Enclosed in [ ], e.g. the time stamp
+    QUOTED,   ///< Enclosed in " ", with \" escapes
+    REQUEST,  ///< A quoted request line, the following METHOD, URL and PROTOCOL fields are its parts
+    METHOD,   ///< The first word of the request line
+    URL,      ///< The second word of the request line
+    PROTOCOL, ///< The rest of the request line, and its closing quote
+  };
+
+  struct Step {
+    Kind kind;
+    askr::KeyId key;
+    std::string_view name; /**< Owned by the key registry */
+  };
+
+  using Steps = std::vector<Step>;
+
+  // Find the closing quote of a quoted field, skipping escaped quotes. Returns end if there is none.
+  const char *
+  closing_quote(const char *start, const char *end)
+  {
+    const char *p = start;
+
+    while ((p = static_cast<const char *>(memchr(p, '"', end - p)))) {
+      const char *bs = p;
+
+      while (bs > start && bs[-1] == '\\') {
+        --bs;
+      }
+      if (((p - bs) & 1) == 0) {
+        return p;
+      }
+      ++p;
+    }
+
+    return end;
+  }
+
+  inline int
+  hex_digit(char c)
+  {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    c |= 0x20;
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+  }
+
+  // Decode the escapes of a quoted value into dst, and return the decoded length. A backslash which does not
+  // start a known escape is taken as it is.
+  size_t
+  unescape(const char *src, size_t len, char *dst)
+  {
+    const char *end = src + len;
+    char *out       = dst;
+
+    while (src < end) {
+      if (*src != '\\' || src + 1 >= end) {
+        *out++ = *src++;
+        continue;
+      }
+      switch (src[1]) {
+      case '"':
+      case '\\':
+        *out++ = src[1];
+        break;
+      case 'b':
+        *out++ = '\b';
+        break;
+      case 'n':
+        *out++ = '\n';
+        break;
+      case 'r':
+        *out++ = '\r';
+        break;
+      case 't':
+        *out++ = '\t';
+        break;
+      case 'v':
+        *out++ = '\v';
+        break;
+      case 'x':
+        if (end - src >= 4 && hex_digit(src[2]) >= 0 && hex_digit(src[3]) >= 0) {
+          *out++ = static_cast<char>(hex_digit(src[2]) << 4 | hex_digit(src[3]));
+          src += 4;
+          continue;
+        }
+        [[fallthrough]];
+      default:
+        *out++ = *src++;
+        continue;
+      }
+      src += 2;
+    }
+
+    return out - dst;
+  }
+
+  // Can the values of this kind of field have escapes?
+  inline bool
+  escaped(Kind kind)
+  {
+    return kind >= Kind::QUOTED;
+  }
+
+  // Scan one field at offset pos of the record, and return the offset of the next field. Returns npos if the
+  // record is exhausted, or does not match the format. A "-" value is left with a nullptr data().
+  size_t
+  scan(Kind kind, std::string_view record, size_t pos, std::string_view &value)
+  {
+    const char *rec = record.data();
+    const char *p   = rec + pos;
+    const char *end = rec + record.size();
+    const char *v   = p;
+    size_t next     = std::string_view::npos;
+
+    if (p >= end) {
+      return std::string_view::npos;
+    }
+
+    switch (kind) {
+    case Kind::WORD: {
+      const char *sp = static_cast<const char *>(memchr(p, ' ', end - p));
+
+      p    = sp ? sp : end;
+      next = p + 1 - rec;
+    } break;
+    case Kind::BRACKET:
+      if (*p != '[' || !(p = static_cast<const char *>(memchr(v + 1, ']', end - v - 1)))) {
+        return std::string_view::npos;
+      }
+      ++v;
+      next = p + 2 - rec;
+      break;
+    case Kind::QUOTED:
+    case Kind::REQUEST:
+      if (*p != '"' || (p = closing_quote(v + 1, end)) == end) {
+        return std::string_view::npos;
+      }
+      ++v;
+      next = (kind == Kind::REQUEST) ? v - rec : p + 2 - rec;
+      break;
+    case Kind::METHOD: {
+      const char *close = closing_quote(p, end);
+      const char *sp    = static_cast<const char *>(memchr(p, ' ', close - p));
+
+      p    = sp ? sp : close;
+      next = p - rec + (sp != nullptr);
+    } break;
+    case Kind::URL: {
+      // The URL runs up to the last space of the request line, it is not supposed to have any spaces itself
+      const char *close = closing_quote(p, end);
+      const char *sp    = static_cast<const char *>(memrchr(p, ' ', close - p));
+
+      p    = sp ? sp : close;
+      next = p - rec + (sp != nullptr);
+    } break;
+    case Kind::PROTOCOL:
+      p    = closing_quote(p, end);
+      next = p + 2 - rec;
+      break;
+    }
+
+    // The parts of the request line can be empty, e.g. for a "-" request
+    if (p == v && kind >= Kind::METHOD) {
+      value = {};
+      return next;
+    }
+
+    if (p - v == 1 && *v == '-') {
+      value = {};
+    } else {
+      value = {v, static_cast<size_t>(p - v)};
+    }
+
+    return next;
+  }
+
+  /**
+   * @class ClfReader
+   * @brief The reader for CLF style access logs.
+   *
+   * A format is a fixed sequence of steps, each of which knows how its field is delimited. Parsing a line is a
+   * single pass over those steps, finding the delimiters with memchr(), and it stops as soon as the last
+   * projected field is found. The lazy next_field() uses the same steps; its position is opaque, and carries the
+   * index of the next step in the upper 32 bits.
+   *
+   * A W3C #Fields: directive replaces the steps, so a batch ends before one, and the steps of each batch are
+   * attached to its Buffer for next_field(). The records of a batch are all tokenized with the same steps.
+   *
+   * The requested values with escapes are decoded into the space set aside at the end of the Buffer, and the
+   * batch ends before a record which could run out of it. The lazy next_field() decodes into memory allocated
+   * from the Buffer. Values without escapes refer directly into the input.
+   */
+  class ClfReader : public askr::Reader
+  {
+  public:
+    void
+    setup(const YAML::Node &node, const askr::OptionValues &) override
+    {
+      auto configs       = node["configs"];
+      std::string format = "combined";
+
+      if (configs && configs["format"]) {
+        format = configs["format"].as<std::string>();
+      }
+
+      if (format == "w3c") {
+        w3c_ = true;
+      } else if (format == "common" || format == "combined") {
+        auto steps = std::make_shared<Steps>();
+
+        add(*steps, Kind::WORD, "client");
+        add(*steps, Kind::WORD, "ident");
+        add(*steps, Kind::WORD, "user");
+        add(*steps, Kind::BRACKET, "time");
+        add(*steps, Kind::REQUEST, "request");
+        add(*steps, Kind::METHOD, "method");
+        add(*steps, Kind::URL, "url");
+        add(*steps, Kind::PROTOCOL, "protocol");
+        add(*steps, Kind::WORD, "status");
+        add(*steps, Kind::WORD, "bytes");
+        if (format == "combined") {
+          add(*steps, Kind::QUOTED, "referer");
+          add(*steps, Kind::QUOTED, "agent");
+        }
+        steps_ = std::move(steps);
+      } else {
+        throw YAML::ParserException(configs["format"].Mark(), "'format' must be one of common, combined or w3c");
+      }
+    }
+
+    size_t
+    parse(askr::RecordBatch &batch, bool eof) override
+    {
+      const char *start = batch.buffer()->data();
+      const char *end   = start + batch.buffer()->size();
+      const char *rec   = start;
+
+      if (!prepared_) {
+        for (auto key : batch.projection().keys()) {
+          projection_.add(key);
+        }
+        prepare();
+        prepared_ = true;
+      }
+
+      while (rec < end) {
+        const char *rec_end = static_cast<const char *>(memchr(rec, '\n', end - rec));
+
+        if (!rec_end) {
+          if (!eof) {
+            break; // Partial record, carried over to the next Buffer
+          }
+          rec_end = end;
+        }
+
+        std::string_view record(rec, rec_end - rec);
+
+        if (!record.empty() && record.back() == '\r') {
+          record.remove_suffix(1);
+        }
+        if (w3c_ && !record.empty() && record[0] == '#') {
+          if (batch.size() > 0 && record.substr(0, FIELDS.size()) == FIELDS) {
+            break; // The fields change, the next batch starts with the directive
+          }
+          directive(record);
+        } else if (!record.empty()) {
+          // The decoded values of the record are never longer than the record itself
+          if (decodes_ && batch.size() > 0 && batch.buffer()->reserved() < record.size() &&
+              memchr(record.data(), '\\', record.size())) {
+            break;
+          }
+
+          size_t row = batch.add_record({static_cast<uint32_t>(rec - start), static_cast<uint32_t>(record.size())});
+
+          tokenize(batch, row, start, record);
+        }
+        rec = rec_end + 1;
+      }
+      batch.buffer()->set_state(steps_);
+
+      return (rec > end ? end : rec) - start;
+    }
+
+    // The scratch space is only needed for requested quoted fields, which are known once prepared
+    size_t
+    reserve(size_t capacity) const override
+    {
+      return (prepared_ && !decodes_) ? 0 : capacity / SCRATCH_SHARE;
+    }
+
+    size_t
+    next_field(askr::Buffer &buffer, std::string_view record, size_t pos, std::string_view &key,
+               std::string_view &value) const override
+    {
+      auto steps  = static_cast<const Steps *>(buffer.state());
+      size_t step = pos >> 32;
+
+      if (!steps || step >= steps->size()) {
+        return std::string_view::npos;
+      }
+
+      size_t next = scan((*steps)[step].kind, record, pos & 0xffffffff, value);
+
+      if (next == std::string_view::npos) {
+        return next;
+      }
+      if (value.data()) {
+        key = (*steps)[step].name;
+        if (escaped((*steps)[step].kind) && memchr(value.data(), '\\', value.size())) {
+          char *decoded = buffer.allocate(value.size());
+
+          value = {decoded, unescape(value.data(), value.size(), decoded)};
+        }
+      }
+
+      return (step + 1 < steps->size() && next < record.size()) ? ((step + 1) << 32) | next : std::string_view::npos;
+    }
+
+  private:
+    static constexpr std::string_view FIELDS = "#Fields:";
+    static constexpr size_t SCRATCH_SHARE    = 16; /**< The share of each Buffer set aside for decoded values */
+
+    static void
+    add(Steps &steps, Kind kind, std::string_view name)
+    {
+      askr::KeyId key = askr::keys::intern(name);
+
+      steps.push_back({kind, key, askr::keys::name(key)});
+    }
+
+    // Figure out which steps are projected, and how far into a line we have to go to find all of them.
+    void
+    prepare()
+    {
+      projected_.clear();
+      last_    = 0;
+      decodes_ = false;
+      if (steps_) {
+        for (size_t ix = 0; ix < steps_->size(); ++ix) {
+          bool wanted = false;
+
+          // Only the explicitly requested keys, everything else is tokenized lazily
+          for (auto key : projection_.keys()) {
+            wanted |= (key == (*steps_)[ix].key);
+          }
+
+          projected_.push_back(wanted);
+          if (wanted) {
+            last_ = ix + 1;
+            decodes_ |= escaped((*steps_)[ix].kind);
+          }
+        }
+      }
+    }
+
+    // The W3C directives, only #Fields: matters. A batch ends before one, so all its records have the same steps.
+    void
+    directive(std::string_view record)
+    {
+      if (record.substr(0, FIELDS.size()) != FIELDS) {
+        return;
+      }
+
+      auto steps = std::make_shared<Steps>();
+
+      record.remove_prefix(FIELDS.size());
+      while (!record.empty()) {
+        size_t sp = record.find(' ');
+
+        if (sp != 0) {
+          add(*steps, Kind::WORD, record.substr(0, sp));
+        }
+        record.remove_prefix(sp == std::string_view::npos ? record.size() : sp + 1);
+      }
+      steps_ = std::move(steps);
+      prepare();
+    }
+
+    // Decode a value with escapes into the scratch space of the Buffer. Only the first record of a batch can run
+    // out of it, in which case the value is left as it is.
+    static askr::Span
+    decode(askr::Buffer &buffer, askr::Span span)
+    {
+      char *decoded = buffer.scratch(span.length);
+
+      if (!decoded) {
+        return span;
+      }
+
+      size_t len = unescape(buffer.data() + span.offset, span.length, decoded);
+
+      buffer.commit(len);
+      return {static_cast<uint32_t>(decoded - buffer.data()), static_cast<uint32_t>(len)};
+    }
+
+    void
+    tokenize(askr::RecordBatch &batch, size_t row, const char *start, std::string_view record)
+    {
+      size_t pos = 0;
+
+      for (size_t ix = 0; ix < last_ && pos != std::string_view::npos; ++ix) {
+        std::string_view value;
+
+        pos = scan((*steps_)[ix].kind, record, pos, value);
+        if (pos != std::string_view::npos && projected_[ix] && value.data()) {
+          askr::Span span = {static_cast<uint32_t>(value.data() - start), static_cast<uint32_t>(value.size())};
+
+          if (escaped((*steps_)[ix].kind) && memchr(value.data(), '\\', value.size())) {
+            span = decode(*batch.buffer(), span);
+          }
+          batch.add_column((*steps_)[ix].key).set(row, span);
+        }
+      }
+    }
+
+    std::shared_ptr<const Steps> steps_;
+    askr::Projection projection_;
+    std::vector<bool> projected_;
+    size_t last_   = 0;     /**< One past the last projected step */
+    bool decodes_  = false; /**< Some projected step can have escapes */
+    bool w3c_      = false;
+    bool prepared_ = false;
+  };
+
+} // namespace
+
+ASKR_PLUGIN(ClfReader)
@@ -18,3 +18,186 @@
  * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
  * specific language governing permissions and limitations under the License.
  */
+#include <array>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include <askr/plugin.h>
+
+namespace
+{
+  // The character classes of the tokenizer, one lookup per input byte
+  enum CharClass : uint8_t {
+    OTHER  = 0,
+    COL    = 1 << 0,
+    KEYVAL = 1 << 1,
+    REC    = 1 << 2,
+  };
+
+  /**
+   * @class CsvReader
+   * @brief The reader for all the "comma separated" formats, configured with the separators to use.
+   *
+   * Only the keys in the projection are materialized as columns. The key of every field is checked against the
+   * projection first, and if it is not requested the value is skipped without any further work. All other fields
+   * are tokenized lazily, one at a time, through next_field(). A key which occurs more than once in a record has
+   * its first value, in the columns the same as in the lazy lookups of KeyValueStore::find().
+   */
+  class CsvReader : public askr::Reader
+  {
+  public:
+    void
+    setup(const YAML::Node &node, const askr::OptionValues &) override
+    {
+      auto configs = node["configs"];
+
+      classes_.fill(OTHER);
+      add_class(configs, "col-separator", COL, "\t");
+      add_class(configs, "keyval-separator", KEYVAL, "=");
+      add_class(configs, "rec-separator", REC, "\n");
+    }
+
+    size_t
+    parse(askr::RecordBatch &batch, bool eof) override
+    {
+      prepare(batch.projection());
+
+      const char *start = batch.buffer()->data();
+      const char *end   = start + batch.buffer()->size();
+      const char *rec   = start;
+
+      while (rec < end) {
+        const char *rec_end = rec;
+
+        while (rec_end < end && !(classes_[static_cast<uint8_t>(*rec_end)] & REC)) {
+          ++rec_end;
+        }
+        if (rec_end == end && !eof) {
+          break; // Partial record, carried over to the next Buffer
+        }
+        if (rec_end > rec) {
+          size_t row = batch.add_record({static_cast<uint32_t>(rec - start), static_cast<uint32_t>(rec_end - rec)});
+
+          tokenize(batch, row, start, rec, rec_end);
+        }
+        rec = rec_end + 1;
+      }
+
+      return (rec > end ? end : rec) - start;
+    }
+
+    size_t
+    next_field(askr::Buffer &, std::string_view record, size_t pos, std::string_view &key,
+               std::string_view &value) const override
+    {
+      const char *p   = record.data() + pos;
+      const char *end = record.data() + record.size();
+      const char *k   = p;
+
+      if (p >= end) {
+        return std::string_view::npos;
+      }
+      while (p < end && !(classes_[static_cast<uint8_t>(*p)] & (COL | KEYVAL))) {
+        ++p;
+      }
+      if (p < end && (classes_[static_cast<uint8_t>(*p)] & KEYVAL)) {
+        const char *v = ++p;
+
+        while (p < end && !(classes_[static_cast<uint8_t>(*p)] & COL)) {
+          ++p;
+        }
+        key   = {k, static_cast<size_t>(v - 1 - k)};
+        value = {v, static_cast<size_t>(p - v)};
+      }
+
+      return p < end ? (p - record.data()) + 1 : std::string_view::npos;
+    }
+
+  private:
+    void
+    add_class(const YAML::Node &configs, const char *name, CharClass cls, const char *dflt)
+    {
+      if (configs && configs[name]) {
+        for (auto const &sep : configs[name]) {
+          std::string str = sep.as<std::string>();
+
+          if (str.size() != 1) {
+            throw YAML::ParserException(sep.Mark(), std::string("'") + name + "' entries must be a single character");
+          }
+          classes_[static_cast<uint8_t>(str[0])] |= cls;
+        }
+      } else {
+        classes_[static_cast<uint8_t>(*dflt)] |= cls;
+      }
+    }
+
+    // Build the lookup tables from the projection. This is only done once, the projection never changes.
+    void
+    prepare(const askr::Projection &projection)
+    {
+      if (prepared_) {
+        return;
+      }
+      for (auto key : projection.keys()) {
+        auto name = askr::keys::name(key);
+
+        known_.emplace(name, key);
+        lengths_ |= uint64_t{1} << (name.size() < 64 ? name.size() : 63);
+      }
+      prepared_ = true;
+    }
+
+    // Find the KeyId for a key, if it is requested. The length bitmask rejects most unrequested keys without hashing.
+    askr::KeyId
+    lookup(std::string_view key) const
+    {
+      if (!(lengths_ & (uint64_t{1} << (key.size() < 64 ? key.size() : 63)))) {
+        return askr::INVALID_KEY;
+      }
+      if (auto it = known_.find(key); it != known_.end()) {
+        return it->second;
+      }
+      return askr::INVALID_KEY;
+    }
+
+    void
+    tokenize(askr::RecordBatch &batch, size_t row, const char *start, const char *p, const char *end)
+    {
+      while (p < end) {
+        const char *key = p;
+
+        while (p < end && !(classes_[static_cast<uint8_t>(*p)] & (COL | KEYVAL))) {
+          ++p;
+        }
+        if (p == end || (classes_[static_cast<uint8_t>(*p)] & COL)) {
+          ++p; // A field without a key-value separator, ignore it
+          continue;
+        }
+
+        askr::KeyId id = lookup({key, static_cast<size_t>(p - key)});
+        const char *val = ++p;
+
+        while (p < end && !(classes_[static_cast<uint8_t>(*p)] & COL)) {
+          ++p;
+        }
+        if (id != askr::INVALID_KEY) {
+          askr::Column &col = batch.add_column(id);
+
+          if (col.is_null(row)) {
+            col.set(row, {static_cast<uint32_t>(val - start), static_cast<uint32_t>(p - val)});
+          }
+        }
+        ++p;
+      }
+    }
+
+    std::array<uint8_t, 256> classes_;
+    std::unordered_map<std::string_view, askr::KeyId> known_;
+    uint64_t lengths_ = 0; /**< Bitmask of the lengths of all requested keys */
+    bool prepared_    = false;
+  };
+
+} // namespace
+
+ASKR_PLUGIN(CsvReader)
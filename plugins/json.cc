@@ -0,0 +1,464 @@
+/**
+ * @file
+ * @brief An output plugin, presenting each record as a JSON object on a line of its own (JSON Lines)
+ *
+ *     - plugin: json.so
+ *
+ * The keys are presented in the order of selector.so, if used, otherwise in the order of the record. The values
+ * that the reader marks as JSON text (see Reader::is_json(), e.g. the numbers, literals and nested objects of
+ * json_reader.so) are presented as they are, if valid. All other values are presented as JSON strings, such that
+ * a string "200" stays a string, and e.g. a status of 200 from a CLF log is presented as "200".
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <cctype>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <askr/plugin.h>
+
+namespace
+{
+  // Does this character have to be escaped in a JSON string?
+  inline bool
+  needs_escape(unsigned char c)
+  {
+    return c < 0x20 || c == '"' || c == '\\';
+  }
+
+  // Find the first character that has to be escaped, 16 bytes at a time where SSE2 is available.
+  size_t
+  find_escape(const char *data, size_t len)
+  {
+    size_t pos = 0;
+
+#if defined(__SSE2__)
+    const __m128i quote     = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control   = _mm_set1_epi8(0x1f);
+
+    for (; pos + 16 <= len; pos += 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + pos));
+      __m128i match = _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash));
+
+      // Unsigned c <= 0x1f, is the same as max(c, 0x1f) == 0x1f
+      match = _mm_or_si128(match, _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control));
+
+      if (int mask = _mm_movemask_epi8(match); mask != 0) {
+        return pos + __builtin_ctz(mask);
+      }
+    }
+#endif
+
+    for (; pos < len; ++pos) {
+      if (needs_escape(static_cast<unsigned char>(data[pos]))) {
+        return pos;
+      }
+    }
+
+    return len;
+  }
+
+  // Append a string to the output, escaped as necessary. Runs of clean characters are copied as they are.
+  void
+  escape(askr::OutputBuffer &out, std::string_view str)
+  {
+    static const char hex[] = "0123456789abcdef";
+    const char *data        = str.data();
+    size_t len              = str.size();
+
+    while (len > 0) {
+      size_t clean = find_escape(data, len);
+
+      out.append(data, clean);
+      if (clean == len) {
+        break;
+      }
+
+      unsigned char c = data[clean];
+      char *dst       = out.reserve(6);
+
+      dst[0] = '\\';
+      switch (c) {
+      case '"':
+      case '\\':
+        dst[1] = c;
+        out.commit(2);
+        break;
+      case '\n':
+        dst[1] = 'n';
+        out.commit(2);
+        break;
+      case '\t':
+        dst[1] = 't';
+        out.commit(2);
+        break;
+      case '\r':
+        dst[1] = 'r';
+        out.commit(2);
+        break;
+      default:
+        dst[1] = 'u';
+        dst[2] = '0';
+        dst[3] = '0';
+        dst[4] = hex[c >> 4];
+        dst[5] = hex[c & 0xf];
+        out.commit(6);
+        break;
+      }
+      data += clean + 1;
+      len -= clean + 1;
+    }
+  }
+
+  // A minimal JSON validator, for the values that can be presented as they are. The nesting is bounded, deeper
+  // values are simply presented as strings.
+  constexpr int MAX_DEPTH = 64;
+
+  bool valid_value(const char *&p, const char *end, int depth);
+
+  inline void
+  skip_space(const char *&p, const char *end)
+  {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+      ++p;
+    }
+  }
+
+  inline bool
+  is_digit(char c)
+  {
+    return c >= '0' && c <= '9';
+  }
+
+  // -?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+  bool
+  valid_number(const char *&p, const char *end)
+  {
+    if (p < end && *p == '-') {
+      ++p;
+    }
+    if (p >= end || !is_digit(*p)) {
+      return false;
+    }
+    if (*p++ != '0') {
+      while (p < end && is_digit(*p)) {
+        ++p;
+      }
+    }
+    if (p < end && *p == '.') {
+      if (++p >= end || !is_digit(*p)) {
+        return false;
+      }
+      while (p < end && is_digit(*p)) {
+        ++p;
+      }
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+      if (++p < end && (*p == '+' || *p == '-')) {
+        ++p;
+      }
+      if (p >= end || !is_digit(*p)) {
+        return false;
+      }
+      while (p < end && is_digit(*p)) {
+        ++p;
+      }
+    }
+
+    return true;
+  }
+
+  // A quoted string, p is at the opening quote
+  bool
+  valid_string(const char *&p, const char *end)
+  {
+    for (++p; p < end; ++p) {
+      unsigned char c = *p;
+
+      if (c == '"') {
+        ++p;
+        return true;
+      } else if (c < 0x20) {
+        return false;
+      } else if (c == '\\') {
+        if (++p >= end) {
+          return false;
+        }
+        if (*p == 'u') {
+          for (int ix = 0; ix < 4; ++ix) {
+            if (++p >= end || !isxdigit(static_cast<unsigned char>(*p))) {
+              return false;
+            }
+          }
+        } else if (!strchr("\"\\/bfnrt", *p) || *p == '\0') {
+          return false;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  bool
+  valid_literal(const char *&p, const char *end, std::string_view literal)
+  {
+    if (static_cast<size_t>(end - p) < literal.size() || std::string_view(p, literal.size()) != literal) {
+      return false;
+    }
+    p += literal.size();
+
+    return true;
+  }
+
+  // An object or array, p is at the opening { or [
+  bool
+  valid_nested(const char *&p, const char *end, int depth)
+  {
+    char close = (*p == '{') ? '}' : ']';
+
+    if (depth >= MAX_DEPTH) {
+      return false;
+    }
+    ++p;
+    skip_space(p, end);
+    if (p < end && *p == close) {
+      ++p;
+      return true;
+    }
+    while (p < end) {
+      if (close == '}') {
+        if (*p != '"' || !valid_string(p, end)) {
+          return false;
+        }
+        skip_space(p, end);
+        if (p >= end || *p++ != ':') {
+          return false;
+        }
+        skip_space(p, end);
+      }
+      if (!valid_value(p, end, depth + 1)) {
+        return false;
+      }
+      skip_space(p, end);
+      if (p >= end) {
+        return false;
+      } else if (*p == close) {
+        ++p;
+        return true;
+      } else if (*p++ != ',') {
+        return false;
+      }
+      skip_space(p, end);
+    }
+
+    return false;
+  }
+
+  bool
+  valid_value(const char *&p, const char *end, int depth)
+  {
+    if (p >= end) {
+      return false;
+    }
+    switch (*p) {
+    case '"':
+      return valid_string(p, end);
+    case '{':
+    case '[':
+      return valid_nested(p, end, depth);
+    case 't':
+      return valid_literal(p, end, "true");
+    case 'f':
+      return valid_literal(p, end, "false");
+    case 'n':
+      return valid_literal(p, end, "null");
+    default:
+      return valid_number(p, end);
+    }
+  }
+
+  // Is the value, which the reader marked as JSON text, valid such that it can be presented as it is? Strings at
+  // the top level are not, their quotes are part of the input and not of the value.
+  bool
+  is_bare(std::string_view value)
+  {
+    if (value.empty()) {
+      return false;
+    }
+
+    const char *p   = value.data();
+    const char *end = p + value.size();
+
+    // Most strings are already rejected on their first character
+    switch (*p) {
+    case '{':
+    case '[':
+    case '-':
+    case 't':
+    case 'f':
+    case 'n':
+      break;
+    default:
+      if (!is_digit(*p)) {
+        return false;
+      }
+    }
+
+    return valid_value(p, end, 0) && p == end;
+  }
+
+  /**
+   * @class Json
+   * @brief The JSON Lines output. Key names are escaped once, per interned key or per name seen in the records, and
+   * the values go through a vectorized scan for characters to escape, such that clean strings are simply copied.
+   */
+  class Json : public askr::Output
+  {
+  public:
+    void
+    columns(askr::Projection &projection) const override
+    {
+      projection.add_all();
+    }
+
+    void
+    output(const askr::RecordBatch &batch) override
+    {
+      const std::vector<askr::KeyId> *keys = batch.layout_keys();
+      askr::OutputBuffer &out              = this->out();
+
+      for (auto row : batch.selection()) {
+        char sep = '{';
+
+        if (keys) {
+          // The selector.so layout, a permutation over the columns of the batch
+          const auto &layout = batch.layout();
+
+          for (size_t ix = 0; ix < keys->size(); ++ix) {
+            std::string_view value;
+
+            if (layout[ix] != askr::RecordBatch::NO_COLUMN) {
+              auto const &col = batch.columns()[layout[ix]];
+
+              if (col.is_null(row)) {
+                continue;
+              }
+              value = batch.view(col.span(row));
+            } else if (value = batch.value((*keys)[ix], row); !value.data()) {
+              continue;
+            }
+            out.append(&sep, 1);
+            out.append(name((*keys)[ix]));
+            present(out, value, batch.is_json(row, value));
+            sep = ',';
+          }
+        } else {
+          askr::KeyValueStore store = batch.store(row);
+
+          for (auto const &field : store.fields()) {
+            out.append(&sep, 1);
+            out.append(name(field.first));
+            present(out, field.second, store.is_json(field.second));
+            sep = ',';
+          }
+        }
+
+        if (sep == '{') {
+          out.append("{}\n", 3);
+        } else {
+          out.append("}\n", 2);
+        }
+      }
+    }
+
+  private:
+    // The most names from the records that are cached, beyond this they are escaped every time. The names come
+    // from the input, so there's no telling how many different ones there are.
+    static constexpr size_t MAX_FIELD_NAMES = 4096;
+
+    // Present a value, either as it is or as a string
+    static void
+    present(askr::OutputBuffer &out, std::string_view value, bool json)
+    {
+      if (json && is_bare(value)) {
+        out.append(value);
+      } else {
+        out.append("\"", 1);
+        escape(out, value);
+        out.append("\"", 1);
+      }
+    }
+
+    // The escaped and quoted key name, including the ':'
+    static std::string
+    quoted(std::string_view name)
+    {
+      askr::OutputBuffer escaped;
+      std::string str;
+
+      escape(escaped, name);
+      str.reserve(escaped.size() + 3);
+      str += '"';
+      str.append(escaped.data(), escaped.size());
+      str += "\":";
+
+      return str;
+    }
+
+    // The quoted key names, cached per interned key
+    std::string_view
+    name(askr::KeyId key)
+    {
+      if (key >= names_.size()) {
+        names_.resize(key + 1);
+      }
+      if (names_[key].empty()) {
+        names_[key] = quoted(askr::keys::name(key));
+      }
+      return names_[key];
+    }
+
+    // The quoted key names, cached per name as it appears in the records. The cached names are kept in a deque,
+    // which never moves its elements, such that the string_view keys of the map remain valid.
+    std::string_view
+    name(std::string_view field)
+    {
+      if (auto it = fields_.find(field); it != fields_.end()) {
+        return it->second;
+      }
+      if (fields_.size() >= MAX_FIELD_NAMES) {
+        scratch_ = quoted(field);
+        return scratch_;
+      }
+      field_names_.emplace_back(field);
+      return fields_.emplace(field_names_.back(), quoted(field)).first->second;
+    }
+
+    std::vector<std::string> names_;
+    std::deque<std::string> field_names_;
+    std::unordered_map<std::string_view, std::string> fields_;
+    std::string scratch_; /**< The quoted name, once the cache is full */
+  };
+
+} // namespace
+
+ASKR_PLUGIN(Json)
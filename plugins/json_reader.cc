@@ -0,0 +1,630 @@
+/**
+ * @file
+ * @brief An input plugin, for JSON Lines input, i.e. one JSON object per line
+ *
+ *     - plugin: json_reader.so
+ *
+ * The top level members of each object are the fields of the record. Nested objects are flattened into dotted
+ * keys, e.g. {"req":{"status":200}} has the field "req.status", but only for keys that are actually referenced
+ * by a filter or the output. Otherwise, the value of a nested object or array is its raw JSON text. String values
+ * refer directly into the input, unless they have escapes: those are decoded, either into space set aside at the
+ * end of each Buffer, or as they are tokenized lazily. Key names are used as they are in the input. All values but
+ * the strings are JSON text (see Reader::is_json()), such that json.so presents them as they are.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <askr/plugin.h>
+
+namespace
+{
+  /**
+   * @brief The bitmasks of the interesting characters in a 64 byte block, bit N is for byte N.
+   */
+  struct BlockMasks {
+    uint64_t quote     = 0;
+    uint64_t backslash = 0;
+    uint64_t op        = 0; /**< The structural operators, {}[]:, */
+  };
+
+  inline bool
+  is_op(char c)
+  {
+    return c == '{' || c == '}' || c == '[' || c == ']' || c == ':' || c == ',';
+  }
+
+  inline bool
+  is_space(char c)
+  {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+  }
+
+  // Classify 64 bytes, 16 at a time where SSE2 is available.
+  BlockMasks
+  classify(const char *p)
+  {
+    BlockMasks masks;
+
+#if defined(__SSE2__)
+    for (int ix = 0; ix < 4; ++ix) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 16 * ix));
+      __m128i op    = _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('{')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8('}')));
+
+      op = _mm_or_si128(op, _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('[')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(']'))));
+      op = _mm_or_si128(op, _mm_or_si128(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(':')), _mm_cmpeq_epi8(chunk, _mm_set1_epi8(','))));
+
+      masks.quote |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('"')))) << (16 * ix);
+      masks.backslash |= static_cast<uint64_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8('\\')))) << (16 * ix);
+      masks.op |= static_cast<uint64_t>(_mm_movemask_epi8(op)) << (16 * ix);
+    }
+#else
+    for (int ix = 0; ix < 64; ++ix) {
+      uint64_t bit = uint64_t{1} << ix;
+
+      masks.quote |= (p[ix] == '"') ? bit : 0;
+      masks.backslash |= (p[ix] == '\\') ? bit : 0;
+      masks.op |= is_op(p[ix]) ? bit : 0;
+    }
+#endif
+
+    return masks;
+  }
+
+  // The characters escaped by a backslash, i.e. preceded by an odd length sequence of backslashes. The carry is
+  // set if the block ends in an escape.
+  uint64_t
+  find_escaped(uint64_t backslash, uint64_t &carry)
+  {
+    constexpr uint64_t EVEN_BITS = 0x5555555555555555ULL;
+
+    backslash &= ~carry;
+
+    uint64_t follows_escape = (backslash << 1) | carry;
+    uint64_t odd_starts     = backslash & ~EVEN_BITS & ~follows_escape;
+    uint64_t even_starts;
+
+    carry = __builtin_add_overflow(odd_starts, backslash, &even_starts) ? 1 : 0;
+
+    return (EVEN_BITS ^ (even_starts << 1)) & follows_escape;
+  }
+
+  inline int
+  hex_digit(char c)
+  {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      return c - 'A' + 10;
+    }
+    return -1;
+  }
+
+  // The code unit of a \uXXXX escape at p, or -1 if it is not one.
+  int32_t
+  code_unit(const char *p, const char *end)
+  {
+    int32_t unit = 0;
+
+    if (end - p < 6 || p[0] != '\\' || p[1] != 'u') {
+      return -1;
+    }
+    for (int ix = 2; ix < 6; ++ix) {
+      int digit = hex_digit(p[ix]);
+
+      if (digit < 0) {
+        return -1;
+      }
+      unit = (unit << 4) | digit;
+    }
+
+    return unit;
+  }
+
+  // Decode the escapes of a JSON string into dst, and return the decoded length. The decoded string is never
+  // longer than the escaped one: a \uXXXX escape is at most three bytes of UTF-8, and a surrogate pair four.
+  // Invalid escapes are copied as they are.
+  size_t
+  unescape(const char *src, size_t len, char *dst)
+  {
+    const char *end = src + len;
+    char *out       = dst;
+
+    while (src < end) {
+      const char *bs = static_cast<const char *>(memchr(src, '\\', end - src));
+
+      if (!bs || bs + 1 >= end) {
+        bs = end;
+      }
+      memmove(out, src, bs - src);
+      out += bs - src;
+      src = bs;
+      if (src >= end) {
+        break;
+      }
+
+      char c = src[1];
+
+      src += 2;
+      switch (c) {
+      case 'b':
+        *out++ = '\b';
+        break;
+      case 'f':
+        *out++ = '\f';
+        break;
+      case 'n':
+        *out++ = '\n';
+        break;
+      case 'r':
+        *out++ = '\r';
+        break;
+      case 't':
+        *out++ = '\t';
+        break;
+      case 'u': {
+        int32_t cp = code_unit(src - 2, end);
+
+        if (cp < 0) {
+          *out++ = '\\';
+          *out++ = c;
+          break;
+        }
+        src += 4;
+        if (cp >= 0xd800 && cp < 0xdc00) {
+          if (int32_t low = code_unit(src, end); low >= 0xdc00 && low < 0xe000) {
+            cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+            src += 6;
+          }
+        }
+        if (cp < 0x80) {
+          *out++ = static_cast<char>(cp);
+        } else if (cp < 0x800) {
+          *out++ = static_cast<char>(0xc0 | (cp >> 6));
+          *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+        } else if (cp < 0x10000) {
+          *out++ = static_cast<char>(0xe0 | (cp >> 12));
+          *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+          *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+        } else {
+          *out++ = static_cast<char>(0xf0 | (cp >> 18));
+          *out++ = static_cast<char>(0x80 | ((cp >> 12) & 0x3f));
+          *out++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3f));
+          *out++ = static_cast<char>(0x80 | (cp & 0x3f));
+        }
+        break;
+      }
+      default:
+        // \" \\ and \/ are the character itself
+        *out++ = c;
+        break;
+      }
+    }
+
+    return out - dst;
+  }
+
+  // Bit N is set if there's an odd number of bits set in [0, N].
+  inline uint64_t
+  prefix_xor(uint64_t bits)
+  {
+    bits ^= bits << 1;
+    bits ^= bits << 2;
+    bits ^= bits << 4;
+    bits ^= bits << 8;
+    bits ^= bits << 16;
+    bits ^= bits << 32;
+
+    return bits;
+  }
+
+  /**
+   * @class JsonReader
+   * @brief The reader for JSON Lines.
+   *
+   * Records with requested keys get a structural index first: the positions of all quotes and operators that
+   * are not inside strings, found 64 bytes at a time with bitmask arithmetic. The requested values are then
+   * extracted by walking just that index, and nested objects are only descended into when a dotted key below
+   * them is requested. Records are never parsed into a DOM, and all other fields are tokenized lazily.
+   *
+   * Strings without escapes are zero copy. The requested strings with escapes are decoded into the space set aside
+   * at the end of the Buffer, such that their Spans work like any other. When that space could run out in a record,
+   * the batch ends before it. The lazy tokenizer decodes into memory allocated from the Buffer.
+   */
+  class JsonReader : public askr::Reader
+  {
+  public:
+    size_t
+    parse(askr::RecordBatch &batch, bool eof) override
+    {
+      prepare(batch.projection());
+
+      const char *start = batch.buffer()->data();
+      const char *end   = start + batch.buffer()->size();
+      const char *rec   = start;
+      size_t reserved   = batch.buffer()->reserved();
+
+      while (rec < end) {
+        const char *rec_end = static_cast<const char *>(memchr(rec, '\n', end - rec));
+
+        if (!rec_end) {
+          if (!eof) {
+            break; // Partial record, carried over to the next Buffer
+          }
+          rec_end = end;
+        }
+        if (rec_end > rec) {
+          if (known_.empty()) {
+            batch.add_record({static_cast<uint32_t>(rec - start), static_cast<uint32_t>(rec_end - rec)});
+          } else {
+            // The decoded strings of the record are never longer than the record itself
+            if (index(rec, rec_end - rec) && batch.size() > 0 && batch.buffer()->reserved() < size_t(rec_end - rec)) {
+              break;
+            }
+
+            size_t row = batch.add_record({static_cast<uint32_t>(rec - start), static_cast<uint32_t>(rec_end - rec)});
+
+            extract(batch, row, start, rec);
+          }
+        }
+        rec = rec_end + 1;
+      }
+      rec      = std::min(rec, end);
+      parsed_  = rec - start;
+      decoded_ = reserved - batch.buffer()->reserved();
+
+      return rec - start;
+    }
+
+    // The scratch space is sized by the share the decoded strings took of the previous batch, with some slack
+    size_t
+    reserve(size_t capacity) const override
+    {
+      size_t share = (parsed_ + decoded_) > 0 ? capacity * decoded_ / (parsed_ + decoded_) * 5 / 4 : 0;
+
+      return std::clamp(share, capacity / MIN_SCRATCH_SHARE, capacity / 2);
+    }
+
+    // A value is a string if it follows its opening quote, or was decoded, i.e. it is not in the record at all
+    bool
+    is_json(std::string_view record, std::string_view value) const override
+    {
+      const char *p = value.data();
+
+      return p > record.data() && p < record.data() + record.size() && p[-1] != '"';
+    }
+
+    // The lazy tokenizer, for the top level members only. This does not need the structural index.
+    size_t
+    next_field(askr::Buffer &buffer, std::string_view record, size_t pos, std::string_view &key,
+               std::string_view &value) const override
+    {
+      const char *p   = record.data() + pos;
+      const char *end = record.data() + record.size();
+
+      while (p < end && (is_space(*p) || *p == '{' || *p == ',')) {
+        ++p;
+      }
+      if (p >= end || *p != '"') {
+        return std::string_view::npos;
+      }
+
+      const char *k = ++p;
+
+      p = skip_string(p, end);
+      if (p >= end) {
+        return std::string_view::npos;
+      }
+      key = {k, static_cast<size_t>(p - k)};
+      ++p;
+      while (p < end && (is_space(*p) || *p == ':')) {
+        ++p;
+      }
+      if (p >= end) {
+        return std::string_view::npos;
+      }
+
+      const char *v = p;
+
+      if (*p == '"') {
+        p     = skip_string(++v, end);
+        value = {v, static_cast<size_t>(std::min(p, end) - v)};
+        if (memchr(value.data(), '\\', value.size())) {
+          char *decoded = buffer.allocate(value.size());
+
+          value = {decoded, unescape(value.data(), value.size(), decoded)};
+        }
+        ++p;
+      } else if (*p == '{' || *p == '[') {
+        p     = skip_nested(p, end);
+        value = {v, static_cast<size_t>(p - v)};
+      } else {
+        while (p < end && *p != ',' && *p != '}') {
+          ++p;
+        }
+        value = trim(v, p);
+      }
+
+      return p < end ? static_cast<size_t>(p - record.data()) : std::string_view::npos;
+    }
+
+  private:
+    // The least share of each Buffer which is set aside for the decoded strings
+    static constexpr size_t MIN_SCRATCH_SHARE = 16;
+
+    // Build the lookup tables from the projection. This is only done once, the projection never changes. The
+    // names are owned by the key registry, so all the string_view's stay valid.
+    void
+    prepare(const askr::Projection &projection)
+    {
+      if (prepared_) {
+        return;
+      }
+      for (auto key : projection.keys()) {
+        auto name = askr::keys::name(key);
+
+        known_.emplace(name, key);
+        for (size_t dot = name.find('.'); dot != std::string_view::npos; dot = name.find('.', dot + 1)) {
+          prefixes_.emplace(name.substr(0, dot));
+        }
+      }
+      prepared_ = true;
+    }
+
+    // The structural index of a record: the positions of all quotes and operators that are not inside strings.
+    // Returns true if the record has any escapes.
+    bool
+    index(const char *rec, size_t len)
+    {
+      uint64_t escape_carry = 0;
+      uint64_t in_string    = 0; // All ones if the previous block ended inside a string
+      uint64_t backslash    = 0;
+
+      index_.clear();
+      for (size_t base = 0; base < len; base += 64) {
+        BlockMasks masks;
+
+        if (base + 64 <= len) {
+          masks = classify(rec + base);
+        } else {
+          char tail[64];
+
+          memset(tail, ' ', sizeof(tail));
+          memcpy(tail, rec + base, len - base);
+          masks = classify(tail);
+        }
+
+        uint64_t quote   = masks.quote & ~find_escaped(masks.backslash, escape_carry);
+
+        backslash |= masks.backslash;
+        uint64_t strings = prefix_xor(quote) ^ in_string;
+        uint64_t bits    = (masks.op & ~strings) | quote;
+
+        in_string = static_cast<uint64_t>(static_cast<int64_t>(strings) >> 63);
+        while (bits) {
+          index_.push_back(static_cast<uint32_t>(base + __builtin_ctzll(bits)));
+          bits &= bits - 1;
+        }
+      }
+      escapes_ = backslash != 0;
+
+      return escapes_;
+    }
+
+    // Walk the structural index of the record, setting the columns of all requested keys.
+    void
+    extract(askr::RecordBatch &batch, size_t row, const char *start, const char *rec)
+    {
+      size_t ix = 0;
+
+      if (!index_.empty() && rec[index_[0]] == '{') {
+        name_.clear();
+        object(batch, row, start, rec, ix);
+      }
+    }
+
+    // Walk one object, ix is at its '{', and is left after its '}'. Returns false on malformed input.
+    bool
+    object(askr::RecordBatch &batch, size_t row, const char *start, const char *rec, size_t &ix)
+    {
+      size_t prefix = name_.size();
+
+      ++ix;
+      while (ix < index_.size()) {
+        char c = rec[index_[ix]];
+
+        if (c == '}') {
+          ++ix;
+          return true;
+        } else if (c == ',') {
+          ++ix;
+          continue;
+        } else if (c != '"' || ix + 2 >= index_.size() || rec[index_[ix + 2]] != ':') {
+          return false;
+        }
+
+        std::string_view key(rec + index_[ix] + 1, index_[ix + 1] - index_[ix] - 1);
+        uint32_t colon = index_[ix + 2];
+
+        ix += 3;
+        if (ix >= index_.size()) {
+          return false;
+        }
+
+        // The full (dotted) name is only built below the top level
+        if (prefix > 0) {
+          name_.resize(prefix);
+          name_ += '.';
+          name_.append(key);
+          key = name_;
+        }
+
+        auto it        = known_.find(key);
+        uint32_t v     = index_[ix];
+        uint32_t v_end = v;
+        char open      = rec[v];
+
+        if (open == '"') {
+          if (ix + 1 >= index_.size()) {
+            return false;
+          }
+          v_end = index_[ix + 1];
+          ++v;
+          ix += 2;
+        } else if (open == '{' || open == '[') {
+          if (open == '{' && prefixes_.count(key) > 0) {
+            if (prefix == 0) {
+              name_.assign(key);
+            }
+            if (!object(batch, row, start, rec, ix)) {
+              return false;
+            }
+          } else if (!skip(rec, ix)) {
+            return false;
+          }
+          v_end = index_[ix - 1] + 1;
+        } else {
+          // A scalar, which runs up to the next structural (, or }). The index does not move.
+          std::string_view val = trim(rec + colon + 1, rec + v);
+
+          v     = val.data() - rec;
+          v_end = v + val.size();
+        }
+
+        if (it != known_.end()) {
+          askr::Column &col = batch.add_column(it->second);
+
+          // A duplicate key keeps its first value, the same as with the lazy lookups
+          if (col.is_null(row)) {
+            askr::Span span{static_cast<uint32_t>(rec - start + v), static_cast<uint32_t>(v_end - v)};
+
+            if (open == '"' && escapes_ && memchr(rec + v, '\\', v_end - v)) {
+              span = decode(*batch.buffer(), span);
+            }
+            col.set(row, span);
+          }
+        }
+        name_.resize(prefix);
+      }
+
+      return false;
+    }
+
+    // Decode a string with escapes into the scratch space of the Buffer. Only the first record of a batch can run
+    // out of it, in which case the string is left as it is.
+    static askr::Span
+    decode(askr::Buffer &buffer, askr::Span span)
+    {
+      char *decoded = buffer.scratch(span.length);
+
+      if (!decoded) {
+        return span;
+      }
+
+      size_t len = unescape(buffer.data() + span.offset, span.length, decoded);
+
+      buffer.commit(len);
+      return {static_cast<uint32_t>(decoded - buffer.data()), static_cast<uint32_t>(len)};
+    }
+
+    // Skip a nested object or array in the index, ix is at its opening, and is left after its closing.
+    bool
+    skip(const char *rec, size_t &ix)
+    {
+      int depth = 0;
+
+      for (; ix < index_.size(); ++ix) {
+        char c = rec[index_[ix]];
+
+        if (c == '{' || c == '[') {
+          ++depth;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+          ++ix;
+          return true;
+        } else if (c == '"') {
+          ++ix; // The closing quote
+        }
+      }
+
+      return false;
+    }
+
+    // Scalar helpers for the lazy tokenizer, which does not have an index
+    static const char *
+    skip_string(const char *p, const char *end)
+    {
+      while (p < end && *p != '"') {
+        p += (*p == '\\') ? 2 : 1;
+      }
+
+      return p;
+    }
+
+    static const char *
+    skip_nested(const char *p, const char *end)
+    {
+      int depth = 0;
+
+      while (p < end) {
+        char c = *p++;
+
+        if (c == '"') {
+          p = skip_string(p, end) + 1;
+        } else if (c == '{' || c == '[') {
+          ++depth;
+        } else if ((c == '}' || c == ']') && --depth == 0) {
+          break;
+        }
+      }
+
+      return std::min(p, end);
+    }
+
+    static std::string_view
+    trim(const char *p, const char *end)
+    {
+      while (p < end && is_space(*p)) {
+        ++p;
+      }
+      while (end > p && is_space(end[-1])) {
+        --end;
+      }
+
+      return {p, static_cast<size_t>(end - p)};
+    }
+
+    std::unordered_map<std::string_view, askr::KeyId> known_;
+    std::unordered_set<std::string_view> prefixes_; /**< All the prefixes of the requested dotted keys */
+    std::vector<uint32_t> index_;
+    std::string name_;       /**< The dotted name of the current member, below the top level */
+    size_t parsed_  = 0;     /**< The input bytes of the previous batch */
+    size_t decoded_ = 0;     /**< The scratch space the previous batch took */
+    bool escapes_   = false; /**< The indexed record has escapes */
+    bool prepared_  = false;
+  };
+
+} // namespace
+
+ASKR_PLUGIN(JsonReader)
@@ -0,0 +1,446 @@
+/**
+ * @file
+ * @brief An input plugin, for lines described by a pattern of literals and typed fields
+ *
+ *     - plugin: pattern_reader.so
+ *       configs:
+ *         pattern: '%{ip:client} - - [%{time:time}] "%{word:method} %{path:url} %{data}" %{int:status} %{int:bytes}'
+ *
+ * A field is %{type:name}, or %{type} to match without capturing, and %% is a literal %. The types are:
+ *
+ *     int         An optionally signed integer
+ *     number      A decimal or floating point number
+ *     word        Letters, digits and _
+ *     host        Letters, digits, ., - and _
+ *     ip          An IPv4 or IPv6 address
+ *     notspace    Anything but spaces and tabs (path is the same)
+ *     data        Anything, up to the first occurrence of the literal that follows it
+ *     greedydata  Anything, up to the last occurrence of the literal that follows it
+ *     time        A time stamp, ISO 8601 / RFC 3339 or as in the Common Log Format, up to the first occurrence of
+ *                 the literal that follows it where it parses as one, e.g. past the space of a CLF time stamp
+ *
+ * The pattern matches from the start of a line, and lines that do not match are skipped. There is no backtracking:
+ * all but data, greedydata and time take the longest run of their characters, stopping at the first character of
+ * the literal that follows them, so they must be delimited well.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <array>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <askr/plugin.h>
+
+namespace
+{
+  /**
+   * @brief The operations of a compiled pattern.
+   */
+  enum class OpType : uint8_t {
+    LITERAL, ///< Match a literal from the pattern
+    RUN,     ///< The longest run of characters in a class
+    UNTIL,   ///< Anything up to the first occurrence of the next literal, or the end of the line
+    REST,    ///< Anything up to the last occurrence of the next literal, or the end of the line
+    TIME,    ///< Like UNTIL, but up to the first occurrence of the next literal where a time stamp parses
+  };
+
+  // The character classes, as bits of the CLASSES table
+  enum Class : uint8_t {
+    INT      = 0x01,
+    NUMBER   = 0x02,
+    WORD     = 0x04,
+    HOST     = 0x08,
+    IP       = 0x10,
+    NOTSPACE = 0x20,
+  };
+
+  struct Type {
+    std::string_view name;
+    OpType type;
+    uint8_t cls;
+  };
+
+  constexpr std::array<Type, 10> TYPES = {{
+    {"int", OpType::RUN, INT},
+    {"number", OpType::RUN, NUMBER},
+    {"word", OpType::RUN, WORD},
+    {"host", OpType::RUN, HOST},
+    {"ip", OpType::RUN, IP},
+    {"notspace", OpType::RUN, NOTSPACE},
+    {"path", OpType::RUN, NOTSPACE},
+    {"data", OpType::UNTIL, 0},
+    {"greedydata", OpType::REST, 0},
+    {"time", OpType::TIME, 0},
+  }};
+
+  // Which classes each character belongs to
+  const std::array<uint8_t, 256> CLASSES = [] {
+    std::array<uint8_t, 256> classes = {};
+
+    for (int c = 0; c < 256; ++c) {
+      bool digit = (c >= '0' && c <= '9');
+      bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+      bool hex   = (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+
+      classes[c] |= (digit || c == '-' || c == '+') ? INT : 0;
+      classes[c] |= (digit || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') ? NUMBER : 0;
+      classes[c] |= (digit || alpha || c == '_') ? WORD : 0;
+      classes[c] |= (digit || alpha || c == '_' || c == '-' || c == '.') ? HOST : 0;
+      classes[c] |= (digit || hex || c == '.' || c == ':') ? IP : 0;
+      classes[c] |= (c != ' ' && c != '\t') ? NOTSPACE : 0;
+    }
+    return classes;
+  }();
+
+  struct Op {
+    OpType type;
+    uint8_t cls     = 0;  /**< The character class of a RUN */
+    int stop        = -1; /**< The first character of the next literal, where a RUN stops */
+    uint32_t offset = 0;  /**< Offset of the LITERAL, or the literal after a capture, in the literal pool */
+    uint32_t length = 0;  /**< Length of that literal, 0 if there is none */
+    askr::KeyId key = askr::INVALID_KEY;
+    std::string_view name; /**< Owned by the key registry */
+  };
+
+  // The longest time stamp that a TIME op tries to parse, which bounds how far it looks for the next literal
+  constexpr size_t MAX_TIME = 64;
+
+  inline bool
+  is_time(const char *start, const char *end)
+  {
+    return askr::TypedValue::parse({start, static_cast<size_t>(end - start)}).type() == askr::TypedValue::TIMESTAMP;
+  }
+
+  // Find the last occurrence of a literal, or nullptr
+  const char *
+  find_last(const char *start, const char *end, const char *lit, size_t len)
+  {
+    if (static_cast<size_t>(end - start) < len) {
+      return nullptr;
+    }
+    for (const char *last = end - len + 1; last > start;) {
+      const char *p = static_cast<const char *>(memrchr(start, lit[0], last - start));
+
+      if (!p) {
+        break;
+      }
+      if (memcmp(p, lit, len) == 0) {
+        return p;
+      }
+      last = p;
+    }
+
+    return nullptr;
+  }
+
+  // Match one op at offset pos of the record, and return the offset after it, or npos if the record does not
+  // match. Captures are returned in value.
+  size_t
+  match(const Op &op, const char *literals, std::string_view record, size_t pos, std::string_view &value)
+  {
+    const char *rec = record.data();
+    const char *end = rec + record.size();
+    const char *p   = rec + pos;
+    const char *lit = literals + op.offset;
+
+    switch (op.type) {
+    case OpType::LITERAL:
+      if (static_cast<size_t>(end - p) < op.length || memcmp(p, lit, op.length) != 0) {
+        return std::string_view::npos;
+      }
+      return pos + op.length;
+    case OpType::RUN:
+      while (p < end && (CLASSES[static_cast<unsigned char>(*p)] & op.cls) && *p != op.stop) {
+        ++p;
+      }
+      if (p == rec + pos) {
+        return std::string_view::npos;
+      }
+      break;
+    case OpType::UNTIL:
+      if (op.length > 0 && !(p = static_cast<const char *>(memmem(p, end - p, lit, op.length)))) {
+        return std::string_view::npos;
+      }
+      p = op.length > 0 ? p : end;
+      break;
+    case OpType::TIME: {
+      // The literal can occur within the time stamp itself, e.g. the space of a CLF time stamp
+      const char *limit = (static_cast<size_t>(end - p) > MAX_TIME + op.length) ? p + MAX_TIME + op.length : end;
+      const char *q     = p;
+
+      if (op.length == 0) {
+        q = is_time(p, end) ? end : nullptr;
+      }
+      while (op.length > 0 && (q = static_cast<const char *>(memmem(q, limit - q, lit, op.length))) && !is_time(p, q)) {
+        ++q;
+      }
+      if (!q) {
+        return std::string_view::npos;
+      }
+      p = q;
+    } break;
+    case OpType::REST:
+      if (op.length > 0 && !(p = find_last(p, end, lit, op.length))) {
+        return std::string_view::npos;
+      }
+      p = op.length > 0 ? p : end;
+      break;
+    }
+
+    value = {rec + pos, static_cast<size_t>(p - rec - pos)};
+
+    return p - rec;
+  }
+
+  /**
+   * @class PatternReader
+   * @brief The reader for user defined line patterns.
+   *
+   * The pattern is compiled once, at setup, into a sequence of literal matches and captures. Each capture is a
+   * single forward scan: a run over a character class table, or a memmem() for the literal that ends it. Every
+   * line is matched in one pass, without backtracking. The lazy next_field() replays the same ops; its position is
+   * opaque, and carries the index of the next op in the upper 32 bits.
+   */
+  class PatternReader : public askr::Reader
+  {
+  public:
+    void
+    setup(const YAML::Node &node, const askr::OptionValues &) override
+    {
+      auto configs = node["configs"];
+
+      if (!configs || !configs["pattern"]) {
+        throw YAML::ParserException(node.Mark(), "pattern_reader.so requires the 'pattern' config");
+      }
+
+      try {
+        compile(configs["pattern"].as<std::string>());
+      } catch (std::invalid_argument &e) {
+        throw YAML::ParserException(configs["pattern"].Mark(), e.what());
+      }
+    }
+
+    size_t
+    parse(askr::RecordBatch &batch, bool eof) override
+    {
+      const char *start = batch.buffer()->data();
+      const char *end   = start + batch.buffer()->size();
+      const char *rec   = start;
+
+      if (!prepared_) {
+        prepare(batch.projection());
+      }
+
+      while (rec < end) {
+        const char *rec_end = static_cast<const char *>(memchr(rec, '\n', end - rec));
+
+        if (!rec_end) {
+          if (!eof) {
+            break; // Partial record, carried over to the next Buffer
+          }
+          rec_end = end;
+        }
+
+        std::string_view record(rec, rec_end - rec);
+
+        if (!record.empty() && record.back() == '\r') {
+          record.remove_suffix(1);
+        }
+        if (!record.empty()) {
+          tokenize(batch, start, record);
+        }
+        rec = rec_end + 1;
+      }
+
+      return (rec > end ? end : rec) - start;
+    }
+
+    size_t
+    next_field(askr::Buffer &, std::string_view record, size_t pos, std::string_view &key,
+               std::string_view &value) const override
+    {
+      size_t ix  = pos >> 32;
+      size_t off = pos & 0xffffffff;
+
+      // Only matching lines are records, so this can not fail, other than on the end of the line
+      for (; ix < ops_.size() && off != std::string_view::npos; ++ix) {
+        std::string_view capture;
+
+        off = match(ops_[ix], literals_.data(), record, off, capture);
+        if (ops_[ix].type != OpType::LITERAL && off != std::string_view::npos) {
+          if (ops_[ix].key != askr::INVALID_KEY) {
+            key   = ops_[ix].name;
+            value = capture;
+          }
+          ++ix;
+          break;
+        }
+      }
+
+      return (ix < ops_.size() && off != std::string_view::npos) ? (ix << 32) | off : std::string_view::npos;
+    }
+
+  private:
+    // Compile the pattern into the ops, all literals are stored in one pool.
+    void
+    compile(const std::string &pattern)
+    {
+      size_t pos = 0;
+
+      while (pos < pattern.size()) {
+        size_t pct = pattern.find('%', pos);
+
+        literal(pattern.substr(pos, pct - pos));
+        if (pct == std::string::npos) {
+          break;
+        }
+        if (pattern.compare(pct, 2, "%%") == 0) {
+          literal("%");
+          pos = pct + 2;
+          continue;
+        }
+        if (pattern.compare(pct, 2, "%{") != 0) {
+          throw std::invalid_argument("'%' must be followed by '{' or '%' in pattern");
+        }
+
+        size_t close = pattern.find('}', pct);
+
+        if (close == std::string::npos) {
+          throw std::invalid_argument("unterminated %{ in pattern");
+        }
+
+        std::string_view field(pattern.data() + pct + 2, close - pct - 2);
+        std::string_view name;
+        size_t colon = field.find(':');
+
+        if (colon != std::string_view::npos) {
+          name  = field.substr(colon + 1);
+          field = field.substr(0, colon);
+        }
+        capture(field, name);
+        pos = close + 1;
+      }
+
+      // Each capture is delimited by the literal that follows it
+      for (size_t ix = 0; ix < ops_.size(); ++ix) {
+        Op &op = ops_[ix];
+
+        if (op.type == OpType::LITERAL) {
+          continue;
+        }
+        if (ix + 1 < ops_.size() && ops_[ix + 1].type == OpType::LITERAL) {
+          op.offset = ops_[ix + 1].offset;
+          op.length = ops_[ix + 1].length;
+          op.stop   = static_cast<unsigned char>(literals_[op.offset]);
+        } else if (ix + 1 < ops_.size() && op.type != OpType::RUN) {
+          throw std::invalid_argument("'data', 'greedydata' and 'time' must be followed by a literal, or end the pattern");
+        }
+      }
+    }
+
+    void
+    literal(std::string_view lit)
+    {
+      if (lit.empty()) {
+        return;
+      }
+      if (!ops_.empty() && ops_.back().type == OpType::LITERAL) {
+        ops_.back().length += lit.size();
+      } else {
+        Op op = {};
+
+        op.type   = OpType::LITERAL;
+        op.offset = literals_.size();
+        op.length = lit.size();
+        ops_.push_back(op);
+      }
+      literals_.append(lit);
+    }
+
+    void
+    capture(std::string_view type, std::string_view name)
+    {
+      for (auto const &t : TYPES) {
+        if (t.name == type) {
+          Op op = {};
+
+          op.type = t.type;
+          op.cls  = t.cls;
+
+          if (!name.empty()) {
+            op.key  = askr::keys::intern(name);
+            op.name = askr::keys::name(op.key);
+          }
+          ops_.push_back(op);
+          return;
+        }
+      }
+
+      throw std::invalid_argument("unknown type '" + std::string(type) + "' in pattern");
+    }
+
+    // Only the explicitly requested keys are captured eagerly, everything else is tokenized lazily
+    void
+    prepare(const askr::Projection &projection)
+    {
+      for (auto const &op : ops_) {
+        bool wanted = false;
+
+        for (auto key : projection.keys()) {
+          wanted |= (op.key != askr::INVALID_KEY && key == op.key);
+        }
+        projected_.push_back(wanted);
+      }
+      spans_.resize(ops_.size());
+      prepared_ = true;
+    }
+
+    // The whole line has to match before it is a record, so the projected captures are held until then
+    void
+    tokenize(askr::RecordBatch &batch, const char *start, std::string_view record)
+    {
+      size_t pos = 0;
+
+      for (size_t ix = 0; ix < ops_.size(); ++ix) {
+        std::string_view value;
+
+        if ((pos = match(ops_[ix], literals_.data(), record, pos, value)) == std::string_view::npos) {
+          return;
+        }
+        if (projected_[ix]) {
+          spans_[ix] = {static_cast<uint32_t>(value.data() - start), static_cast<uint32_t>(value.size())};
+        }
+      }
+
+      size_t row = batch.add_record({static_cast<uint32_t>(record.data() - start), static_cast<uint32_t>(record.size())});
+
+      for (size_t ix = 0; ix < ops_.size(); ++ix) {
+        if (projected_[ix]) {
+          batch.add_column(ops_[ix].key).set(row, spans_[ix]);
+        }
+      }
+    }
+
+    std::vector<Op> ops_;
+    std::string literals_;
+    std::vector<bool> projected_;
+    std::vector<askr::Span> spans_;
+    bool prepared_ = false;
+  };
+
+} // namespace
+
+ASKR_PLUGIN(PatternReader)
@@ -0,0 +1,90 @@
+/**
+ * @file
+ * @brief A filter plugin, which selects the keys (and their order) to present in the output
+ *
+ * The keys come from a script option, e.g.
+ *
+ *     - plugin: selector.so
+ *       configs:
+ *         option: selKeys
+ *
+ * which would typically be populated with something like "-s time,status,url".
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <askr/plugin.h>
+
+namespace
+{
+  /**
+   * @class Selector
+   * @brief The filter which dictates the output keys, and their order.
+   *
+   * The selected keys are resolved to KeyIds once, at setup, into a fixed plan which is shared by all batches.
+   * Since the keys are also added to the projection, the reader materializes them as columns, and applying the
+   * plan is just a permutation over the batch's columns. No per record containers are ever built.
+   */
+  class Selector : public askr::Filter
+  {
+  public:
+    void
+    setup(const YAML::Node &node, const askr::OptionValues &values) override
+    {
+      auto configs = node["configs"];
+
+      if (!configs || !configs["option"]) {
+        throw YAML::ParserException(node.Mark(), "selector.so requires the 'option' config");
+      }
+
+      auto plan = std::make_shared<std::vector<askr::KeyId>>();
+
+      for (auto const &key : values.get(configs["option"].as<std::string>())) {
+        plan->push_back(askr::keys::intern(key));
+      }
+
+      // Without any selected keys, all fields are presented as they are
+      if (!plan->empty()) {
+        plan_ = std::move(plan);
+      }
+    }
+
+    void
+    columns(askr::Projection &projection) const override
+    {
+      if (plan_) {
+        for (auto key : *plan_) {
+          projection.add(key);
+        }
+      }
+    }
+
+    void
+    process(askr::RecordBatch &batch) override
+    {
+      if (plan_) {
+        batch.set_layout(plan_);
+      }
+    }
+
+  private:
+    std::shared_ptr<const std::vector<askr::KeyId>> plan_;
+  };
+
+} // namespace
+
+ASKR_PLUGIN(Selector)
@@ -0,0 +1,507 @@
+/**
+ * @file
+ * @brief An input plugin, for syslog messages, in either RFC 5424 or RFC 3164 (BSD) format
+ *
+ *     - plugin: syslog_reader.so
+ *
+ * The fields are pri, version, time, host, app, procid, msgid and msg, as far as the format of each line has
+ * them; the format is detected per line. For RFC 3164, app is the tag, and procid what follows it in [ ]. The
+ * parameters of RFC 5424 structured data are fields named "<SD-ID>.<PARAM-NAME>", e.g. "origin.ip". A value of
+ * "-" (the NILVALUE) means the field is not present. Values refer directly into the input, except for structured
+ * data values with escapes (\", \\ and \]), which are decoded.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <askr/plugin.h>
+
+namespace
+{
+  /**
+   * @brief The states of the scanner, each state scans one field (or one structured data parameter).
+   */
+  enum State : uint8_t {
+    PRI,
+    VERS,
+    TIME,
+    HOST,
+    APP,
+    PROCID,
+    MSGID,
+    SD,
+    MSG,
+    BSD_TIME,
+    BSD_HOST,
+    BSD_TAG,
+    BSD_PROCID,
+    DONE,
+    NUM_STATES,
+  };
+
+  // The field name of each state, and its rank in the line (which is the same for both formats)
+  constexpr std::array<const char *, NUM_STATES> NAMES = {"pri", "version", "time",  "host",   "app", "procid", "msgid",
+                                                          "",    "msg",     "time",  "host",   "app", "procid", ""};
+  constexpr std::array<uint8_t, NUM_STATES> RANKS      = {0, 1, 2, 3, 4, 5, 6, 7, 8, 2, 3, 4, 5, 9};
+
+  /**
+   * @brief Where the scanner is in a line. For structured data, element is the offset of the current SD-ID.
+   */
+  struct Cursor {
+    State state      = PRI;
+    uint32_t pos     = 0;
+    uint32_t element = 0;
+  };
+
+  /**
+   * @brief One scanned field. For structured data parameters, the SD-ID and the parameter name are set.
+   */
+  struct Token {
+    State state;
+    std::string_view value; /**< With a nullptr data() if the field is not present */
+    std::string_view sd_id;
+    std::string_view param;
+  };
+
+  // Find the closing quote of a structured data value, skipping escaped quotes. Returns end if there is none.
+  const char *
+  closing_quote(const char *start, const char *end)
+  {
+    const char *p = start;
+
+    while ((p = static_cast<const char *>(memchr(p, '"', end - p)))) {
+      const char *bs = p;
+
+      while (bs > start && bs[-1] == '\\') {
+        --bs;
+      }
+      if (((p - bs) & 1) == 0) {
+        return p;
+      }
+      ++p;
+    }
+
+    return end;
+  }
+
+  // Decode the escapes of a structured data value into dst, and return the decoded length. Only \", \\ and \] are
+  // escapes, any other backslash is taken as it is (RFC 5424, section 6.3.3).
+  size_t
+  unescape(const char *src, size_t len, char *dst)
+  {
+    const char *end = src + len;
+    char *out       = dst;
+
+    while (src < end) {
+      if (*src == '\\' && src + 1 < end && (src[1] == '"' || src[1] == '\\' || src[1] == ']')) {
+        ++src;
+      }
+      *out++ = *src++;
+    }
+
+    return out - dst;
+  }
+
+  // The end of a space delimited word
+  inline const char *
+  word_end(const char *p, const char *end)
+  {
+    const char *sp = static_cast<const char *>(memchr(p, ' ', end - p));
+
+    return sp ? sp : end;
+  }
+
+  // Scan the structured data, one parameter at a time: [SD-ID PARAM-NAME="PARAM-VALUE" ...][...] or "-".
+  bool
+  structured_data(std::string_view record, Cursor &cur, Token &tok)
+  {
+    const char *rec = record.data();
+    const char *end = rec + record.size();
+    const char *p   = rec + cur.pos;
+
+    if (p < end && *p != '-') {
+      while (p < end) {
+        if (*p == '[') {
+          cur.element = ++p - rec;
+          while (p < end && *p != ' ' && *p != ']') {
+            ++p;
+          }
+        } else if (*p == ' ') {
+          // A parameter, name="value"
+          const char *name = p + 1;
+          const char *eq   = static_cast<const char *>(memchr(name, '=', end - name));
+
+          if (!eq || eq + 1 >= end || eq[1] != '"') {
+            break;
+          }
+
+          const char *close  = closing_quote(eq + 2, end);
+          const char *id     = rec + cur.element;
+          const char *id_end = id;
+
+          while (id_end < end && *id_end != ' ' && *id_end != ']') {
+            ++id_end;
+          }
+          tok.sd_id = {id, static_cast<size_t>(id_end - id)};
+          tok.param = {name, static_cast<size_t>(eq - name)};
+          tok.value = {eq + 2, static_cast<size_t>(close - eq - 2)};
+          cur.pos   = std::min(close + 1, end) - rec;
+          return true;
+        } else if (*p == ']' && p + 1 < end && p[1] == '[') {
+          ++p;
+        } else {
+          break;
+        }
+      }
+    } else {
+      ++p;
+    }
+
+    // The end of the last element, or the NILVALUE, followed by the message
+    if (p < end && *p == ']') {
+      ++p;
+    }
+    cur.state = MSG;
+    cur.pos   = std::min(p + 1, end) - rec;
+
+    return true;
+  }
+
+  // Scan the next token of a line, and advance the cursor. Returns false when the line is exhausted.
+  bool
+  scan(std::string_view record, Cursor &cur, Token &tok)
+  {
+    const char *rec = record.data();
+    const char *end = rec + record.size();
+    const char *p   = rec + cur.pos; // The next field
+    const char *v   = p;             // The value, from v to e
+    const char *e   = p;
+
+    tok = {cur.state, {}, {}, {}};
+    if (p > end) {
+      return false;
+    }
+
+    switch (cur.state) {
+    case PRI:
+      e = (p < end && *p == '<') ? static_cast<const char *>(memchr(p, '>', std::min<ptrdiff_t>(end - p, 5))) : nullptr;
+      if (!e) {
+        // Not syslog framed, the whole line is the message
+        cur.state = MSG;
+        return true;
+      }
+      ++v;
+      p         = e + 1;
+      cur.state = (end - p >= 2 && p[0] >= '1' && p[0] <= '9' && p[1] == ' ') ? VERS : BSD_TIME;
+      break;
+    case VERS:
+    case TIME:
+    case HOST:
+    case APP:
+    case PROCID:
+    case MSGID:
+    case BSD_HOST:
+      p = e     = word_end(p, end);
+      cur.state = static_cast<State>(cur.state + 1);
+      break;
+    case BSD_TIME:
+      // Always "Mmm dd hh:mm:ss"
+      if (end - p < 16 || p[15] != ' ') {
+        cur.state = MSG;
+        return true;
+      }
+      p = e     = v + 15;
+      cur.state = BSD_HOST;
+      break;
+    case BSD_TAG:
+      while (e < end && *e != '[' && *e != ':' && *e != ' ') {
+        ++e;
+      }
+      if (e == end || *e == ' ') {
+        // No tag, this is already the message
+        cur.state = MSG;
+        return true;
+      }
+      p         = e + 1;
+      cur.state = (*e == '[') ? BSD_PROCID : MSG;
+      break;
+    case BSD_PROCID:
+      e         = static_cast<const char *>(memchr(v, ']', end - v));
+      e         = e ? e : end;
+      p         = e + 1 + (e + 1 < end && e[1] == ':');
+      cur.state = MSG;
+      break;
+    case SD:
+      return structured_data(record, cur, tok);
+    case MSG:
+      if (end - p >= 3 && memcmp(p, "\xEF\xBB\xBF", 3) == 0) {
+        v += 3; // The UTF-8 BOM
+      }
+      p = e     = end;
+      cur.state = DONE;
+      break;
+    default:
+      return false;
+    }
+
+    if (v < e && !(e - v == 1 && *v == '-')) {
+      tok.value = {v, static_cast<size_t>(e - v)};
+    }
+    while (p < end && *p == ' ') {
+      ++p;
+    }
+    cur.pos = p - rec;
+
+    return true;
+  }
+
+  /**
+   * @class SyslogReader
+   * @brief The reader for syslog messages.
+   *
+   * Each line is scanned by a small state machine, one field per state, without any regular expressions. The
+   * scan stops as soon as all the projected fields are found. The lazy next_field() runs the same state machine,
+   * with the state and the current SD-ID offset packed into the upper bits of its (opaque) position.
+   *
+   * The requested structured data values with escapes are decoded into the space set aside at the end of the
+   * Buffer, and the batch ends before a record which could run out of it. The lazy next_field() decodes into
+   * memory allocated from the Buffer. The names of the parameters come from the input, so the ones that were not
+   * requested are not interned, see param_name().
+   */
+  class SyslogReader : public askr::Reader
+  {
+  public:
+    size_t
+    parse(askr::RecordBatch &batch, bool eof) override
+    {
+      prepare(batch.projection());
+
+      const char *start = batch.buffer()->data();
+      const char *end   = start + batch.buffer()->size();
+      const char *rec   = start;
+
+      while (rec < end) {
+        const char *rec_end = static_cast<const char *>(memchr(rec, '\n', end - rec));
+
+        if (!rec_end) {
+          if (!eof) {
+            break; // Partial record, carried over to the next Buffer
+          }
+          rec_end = end;
+        }
+
+        std::string_view record(rec, rec_end - rec);
+
+        if (!record.empty() && record.back() == '\r') {
+          record.remove_suffix(1);
+        }
+        if (!record.empty()) {
+          // The decoded values of the record are never longer than the record itself
+          if (!params_.empty() && batch.size() > 0 && batch.buffer()->reserved() < record.size() &&
+              memchr(record.data(), '\\', record.size())) {
+            break;
+          }
+
+          size_t row = batch.add_record({static_cast<uint32_t>(rec - start), static_cast<uint32_t>(record.size())});
+
+          tokenize(batch, row, start, record);
+        }
+        rec = rec_end + 1;
+      }
+
+      return (rec > end ? end : rec) - start;
+    }
+
+    // The scratch space is only needed for requested structured data parameters, which are known once prepared
+    size_t
+    reserve(size_t capacity) const override
+    {
+      return (prepared_ && params_.empty()) ? 0 : capacity / SCRATCH_SHARE;
+    }
+
+    size_t
+    next_field(askr::Buffer &buffer, std::string_view record, size_t pos, std::string_view &key,
+               std::string_view &value) const override
+    {
+      Cursor cur = {static_cast<State>(pos >> 56), static_cast<uint32_t>(pos), static_cast<uint32_t>((pos >> 32) & 0xffffff)};
+      Token tok;
+
+      if (!scan(record, cur, tok)) {
+        return std::string_view::npos;
+      }
+      if (tok.value.data()) {
+        value = tok.value;
+        if (tok.sd_id.data()) {
+          key = param_name(buffer, tok.sd_id, tok.param);
+          if (memchr(value.data(), '\\', value.size())) {
+            char *decoded = buffer.allocate(value.size());
+
+            value = {decoded, unescape(value.data(), value.size(), decoded)};
+          }
+        } else {
+          key = NAMES[tok.state];
+        }
+      }
+
+      return (cur.state == DONE) ? std::string_view::npos
+                                 : (size_t{cur.state} << 56) | (size_t{cur.element} << 32) | cur.pos;
+    }
+
+  private:
+    static constexpr size_t SCRATCH_SHARE = 16;  /**< The share of each Buffer set aside for decoded values */
+    static constexpr size_t MAX_NAMES     = 4096; /**< The most parameter names cached by param_name() */
+
+    // The name "<SD-ID>.<PARAM-NAME>" of a structured data parameter, for the lazy tokenizer. The requested names
+    // are owned by the key registry. All others are cached here, rather than interned, and once the cache is full
+    // they are allocated from the Buffer. The workers share the cache, hence the lock.
+    std::string_view
+    param_name(askr::Buffer &buffer, std::string_view sd_id, std::string_view param) const
+    {
+      thread_local std::string name;
+
+      name.assign(sd_id);
+      name += '.';
+      name.append(param);
+      if (auto it = params_.find(name); it != params_.end()) {
+        return it->first;
+      }
+      {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+
+        if (auto it = names_.find(name); it != names_.end()) {
+          return *it;
+        }
+      }
+
+      std::unique_lock<std::shared_mutex> lock(mutex_);
+
+      if (auto it = names_.find(name); it != names_.end()) {
+        return *it;
+      }
+      if (names_.size() < MAX_NAMES) {
+        storage_.emplace_back(name);
+        return *names_.insert(storage_.back()).first;
+      }
+      lock.unlock();
+
+      char *copy = buffer.allocate(name.size());
+
+      memcpy(copy, name.data(), name.size());
+      return {copy, name.size()};
+    }
+
+    // Decode a value with escapes into the scratch space of the Buffer. Only the first record of a batch can run
+    // out of it, in which case the value is left as it is.
+    static askr::Span
+    decode(askr::Buffer &buffer, askr::Span span)
+    {
+      char *decoded = buffer.scratch(span.length);
+
+      if (!decoded) {
+        return span;
+      }
+
+      size_t len = unescape(buffer.data() + span.offset, span.length, decoded);
+
+      buffer.commit(len);
+      return {static_cast<uint32_t>(decoded - buffer.data()), static_cast<uint32_t>(len)};
+    }
+
+    // Build the lookup tables from the projection. This is only done once, the projection never changes.
+    void
+    prepare(const askr::Projection &projection)
+    {
+      if (prepared_) {
+        return;
+      }
+      keys_.fill(askr::INVALID_KEY);
+      for (auto key : projection.keys()) {
+        auto name = askr::keys::name(key);
+        bool fixed = false;
+
+        for (size_t state = 0; state < NUM_STATES; ++state) {
+          if (name == NAMES[state]) {
+            keys_[state] = key;
+            last_rank_   = std::max(last_rank_, RANKS[state]);
+            fixed        = true;
+          }
+        }
+        if (!fixed && name.find('.') != std::string_view::npos) {
+          params_.emplace(name, key);
+          last_rank_ = std::max(last_rank_, RANKS[SD]);
+        }
+      }
+      prepared_ = true;
+    }
+
+    void
+    tokenize(askr::RecordBatch &batch, size_t row, const char *start, std::string_view record)
+    {
+      Cursor cur;
+      Token tok;
+
+      while (RANKS[cur.state] <= last_rank_ && scan(record, cur, tok)) {
+        if (!tok.value.data()) {
+          continue;
+        }
+
+        askr::KeyId key = keys_[tok.state];
+
+        if (tok.sd_id.data()) {
+          name_.assign(tok.sd_id);
+          name_ += '.';
+          name_.append(tok.param);
+          if (auto it = params_.find(name_); it != params_.end()) {
+            key = it->second;
+          }
+        }
+        if (key == askr::INVALID_KEY) {
+          continue;
+        }
+
+        askr::Column &col = batch.add_column(key);
+
+        // A repeated parameter keeps its first value, the same as with the lazy lookups
+        if (col.is_null(row)) {
+          askr::Span span = {static_cast<uint32_t>(tok.value.data() - start), static_cast<uint32_t>(tok.value.size())};
+
+          if (tok.sd_id.data() && memchr(tok.value.data(), '\\', tok.value.size())) {
+            span = decode(*batch.buffer(), span);
+          }
+          col.set(row, span);
+        }
+      }
+    }
+
+    std::array<askr::KeyId, NUM_STATES> keys_;                 /**< The projected KeyId of each state's field */
+    std::unordered_map<std::string_view, askr::KeyId> params_; /**< The projected structured data parameters */
+    std::string name_;
+    mutable std::shared_mutex mutex_;                          /**< Guards the cached names */
+    mutable std::deque<std::string> storage_;                  /**< The cached names, which never move */
+    mutable std::unordered_set<std::string_view> names_;       /**< The cached names that were not requested */
+    uint8_t last_rank_ = 0;
+    bool prepared_     = false;
+  };
+
+} // namespace
+
+ASKR_PLUGIN(SyslogReader)
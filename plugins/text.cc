@@ -0,0 +1,243 @@
+/**
+ * @file
+ * @brief An output plugin, presenting the records as text, using a configurable format
+ *
+ * The format is a template with $(name) substitutions, e.g.
+ *
+ *     - plugin: text.so
+ *       configs:
+ *         format: "$(key)=$(value)"
+ *         col-separator: "\t"
+ *         rec-separator: "\n"
+ *
+ * A format using $(key) and / or $(value) is rendered once per field, with the fields separated by the
+ * col-separator. Any other name is a key of the record, and such a format is rendered once per record.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <string>
+#include <vector>
+
+#include <askr/plugin.h>
+
+namespace
+{
+  /**
+   * @brief The operations of a compiled format.
+   */
+  enum class OpType : uint8_t {
+    LITERAL, ///< Copy a literal from the format
+    KEY,     ///< Emit the key of the current field
+    VALUE,   ///< Emit the value of the current field
+    FIELD,   ///< Emit the value of a named key of the record
+  };
+
+  struct Op {
+    OpType type;
+    uint32_t offset = 0; /**< Offset of a LITERAL in the literal pool */
+    uint32_t length = 0; /**< Length of a LITERAL */
+    askr::KeyId key = askr::INVALID_KEY;
+  };
+
+  /**
+   * @class Text
+   * @brief The text output. The format is compiled once, at setup, into a sequence of literal copies and field
+   * emits, and every record is rendered straight into the OutputBuffer.
+   */
+  class Text : public askr::Output
+  {
+  public:
+    void
+    setup(const YAML::Node &node, const askr::OptionValues &) override
+    {
+      auto configs       = node["configs"];
+      std::string format = "$(key)=$(value)";
+
+      if (configs) {
+        if (configs["format"]) {
+          format = configs["format"].as<std::string>();
+        }
+        if (configs["col-separator"]) {
+          col_sep_ = configs["col-separator"].as<std::string>();
+        }
+        if (configs["rec-separator"]) {
+          rec_sep_ = configs["rec-separator"].as<std::string>();
+        }
+      }
+
+      try {
+        compile(format);
+      } catch (std::invalid_argument &e) {
+        throw YAML::ParserException(configs["format"].Mark(), e.what());
+      }
+    }
+
+    void
+    columns(askr::Projection &projection) const override
+    {
+      if (per_field_) {
+        projection.add_all();
+      } else {
+        for (auto const &op : ops_) {
+          if (op.type == OpType::FIELD) {
+            projection.add(op.key);
+          }
+        }
+      }
+    }
+
+    void
+    output(const askr::RecordBatch &batch) override
+    {
+      const std::vector<askr::KeyId> *keys = batch.layout_keys();
+
+      for (auto row : batch.selection()) {
+        if (!per_field_) {
+          render(batch, row, {}, {});
+        } else if (keys) {
+          // The selector.so layout, a permutation over the columns of the batch
+          const auto &layout = batch.layout();
+          bool first         = true;
+
+          for (size_t ix = 0; ix < keys->size(); ++ix) {
+            std::string_view value;
+
+            if (layout[ix] != askr::RecordBatch::NO_COLUMN) {
+              auto const &col = batch.columns()[layout[ix]];
+
+              if (col.is_null(row)) {
+                continue;
+              }
+              value = batch.view(col.span(row));
+            } else if (value = batch.value((*keys)[ix], row); !value.data()) {
+              continue;
+            }
+            if (!first) {
+              append(col_sep_.data(), col_sep_.size());
+            }
+            render(batch, row, name((*keys)[ix]), value);
+            first = false;
+          }
+        } else {
+          askr::KeyValueStore store = batch.store(row);
+          bool first                = true;
+
+          for (auto const &field : store.fields()) {
+            if (!first) {
+              append(col_sep_.data(), col_sep_.size());
+            }
+            render(batch, row, field.first, field.second);
+            first = false;
+          }
+        }
+        append(rec_sep_.data(), rec_sep_.size());
+      }
+    }
+
+  private:
+    // Compile the format into the ops, all literals are stored in one pool.
+    void
+    compile(const std::string &format)
+    {
+      size_t pos = 0;
+
+      while (pos < format.size()) {
+        size_t start = format.find("$(", pos);
+        size_t lit   = (start == std::string::npos ? format.size() : start) - pos;
+
+        if (lit > 0) {
+          ops_.push_back({OpType::LITERAL, static_cast<uint32_t>(literals_.size()), static_cast<uint32_t>(lit)});
+          literals_.append(format, pos, lit);
+        }
+        if (start == std::string::npos) {
+          break;
+        }
+
+        size_t end = format.find(')', start + 2);
+
+        if (end == std::string::npos) {
+          throw std::invalid_argument("unterminated $( in format");
+        }
+
+        std::string_view name(format.data() + start + 2, end - start - 2);
+
+        if (name == "key") {
+          ops_.push_back({OpType::KEY});
+          per_field_ = true;
+        } else if (name == "value") {
+          ops_.push_back({OpType::VALUE});
+          per_field_ = true;
+        } else if (!name.empty()) {
+          ops_.push_back({OpType::FIELD, 0, 0, askr::keys::intern(name)});
+        } else {
+          throw std::invalid_argument("empty $() in format");
+        }
+        pos = end + 1;
+      }
+    }
+
+    void
+    render(const askr::RecordBatch &batch, size_t row, std::string_view key, std::string_view value)
+    {
+      for (auto const &op : ops_) {
+        switch (op.type) {
+        case OpType::LITERAL:
+          append(literals_.data() + op.offset, op.length);
+          break;
+        case OpType::KEY:
+          append(key.data(), key.size());
+          break;
+        case OpType::VALUE:
+          append(value.data(), value.size());
+          break;
+        case OpType::FIELD: {
+          std::string_view val = batch.value(op.key, row);
+
+          append(val.data(), val.size());
+        } break;
+        }
+      }
+    }
+
+    // The names of the interned keys, cached to avoid the registry lock for every field
+    std::string_view
+    name(askr::KeyId key)
+    {
+      if (key >= names_.size()) {
+        names_.resize(key + 1);
+      }
+      if (!names_[key].data()) {
+        names_[key] = askr::keys::name(key);
+      }
+      return names_[key];
+    }
+
+    void
+    append(const char *data, size_t len)
+    {
+      out().append(data, len);
+    }
+
+    std::vector<Op> ops_;
+    std::string literals_;
+    std::string col_sep_ = "\t";
+    std::string rec_sep_ = "\n";
+    bool per_field_      = false;
+
+    std::vector<std::string_view> names_;
+  };
+
+} // namespace
+
+ASKR_PLUGIN(Text)
@@ -23,12 +23,18 @@
 #include <fstream>
 #include <exception>
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
 
 #include <getopt.h>
 #include <yaml-cpp/yaml.h>
 #include <jemalloc/jemalloc.h>
 
 #include "options.h"
+#include "pipeline.h"
+#include "askr/buffers.h"
 #include "gsl/gsl"
 
 namespace askr
@@ -40,6 +46,47 @@ namespace askr
   } // namespace debug
 } // namespace askr
 
+// The -t option is limited to something sane, more threads than this would just compete for the reader
+static constexpr size_t MAX_THREADS = 256;
+
+// The reader holds on to one chunk for the carry over while reading into the next, so the pool needs at least two
+static constexpr size_t MIN_CHUNKS = 2;
+
+// The smallest --max-memory that can be honored, the pool of the least chunks is half of it
+static constexpr size_t MIN_MEMORY = 2 * MIN_CHUNKS * askr::BufferPool::DEFAULT_CHUNK_SIZE;
+
+// Parse a size in bytes, with an optional K, M, G or T suffix (powers of 1024), returning 0 if it's invalid
+static size_t
+parse_size(const char *arg)
+{
+  char *end;
+  unsigned long long size = strtoull(arg, &end, 10);
+
+  if (end == arg || *arg == '-') {
+    return 0;
+  }
+  switch (*end ? toupper(*end++) : 0) {
+  case 'T':
+    size <<= 10;
+    [[fallthrough]];
+  case 'G':
+    size <<= 10;
+    [[fallthrough]];
+  case 'M':
+    size <<= 10;
+    [[fallthrough]];
+  case 'K':
+    size <<= 10;
+    [[fallthrough]];
+  case 0:
+    break;
+  default:
+    return 0;
+  }
+
+  return *end ? 0 : size;
+}
+
 /**
  * @brief main() is obviously the regular unix entry point.... Duh.
  *
@@ -55,23 +102,34 @@ main(int argc, char **argv)
   // with the addition of script specific options. Note that these don't populate the name field, that is
   // only used (and needed) by plugins for identification.
   askr::Options askr_options = {
-    {{"debug", 'D', "enable and set a debug level (bit-field)", required_argument},
+    {{"expression", 'e', "query expression, e.g. key1=val1", required_argument},
+     {"debug", 'D', "enable and set a debug level (bit-field)", required_argument},
      {"verbose", 'V', "enable verbose output and results ", no_argument},
+     {"stats", 'S', "report per plugin statistics at exit, and every N seconds with --stats=N", optional_argument},
+     {"max-memory", 'M', "bound the memory use, e.g. 2G (at least 16M), by holding back the reader", required_argument},
+     {"prefault", 'P', "pre-fault the buffer pool memory at startup", no_argument},
+     {"output", 'o', "the output plugin to use, instead of the script's output", required_argument},
+     {"threads", 't', "number of threads filtering and producing the output", required_argument},
+     {"jit", 'J', "compile the query expressions to native code, for long running queries", no_argument},
      {"help", 'H', "show the help message (this)", no_argument}}
   };
-  bool verbose_flag = false;
-  int option_index  = 0;
+  askr::OptionValues option_values;
+  bool verbose_flag  = false;
+  bool prefault_flag = false;
+  size_t threads     = 1;
+  int option_index   = 0;
 
   if (GSL_LIKELY(argc >= 2)) {
     YAML::Node config;
+    std::string script = argv[1]; // getopt_long() permutes argv, so hold on to this
 
     // Get the YAML config first, so we can extend the option parsing with specific script
     // options as necessary.
     try {
-      config = YAML::LoadFile(argv[1]);
+      config = YAML::LoadFile(script);
       Expects(config);
     } catch (std::exception &e) {
-      std::cerr << "error in " << argv[1] << ": " << e.what() << std::endl;
+      std::cerr << "error in " << script << ": " << e.what() << std::endl;
       return 1;
     }
     if (!config.IsMap()) {
@@ -83,7 +141,7 @@ main(int argc, char **argv)
     try {
       askr_options.add_yaml(config["options"]);
     } catch (std::exception &e) {
-      std::cerr << "error in " << argv[1] << ": " << e.what() << std::endl;
+      std::cerr << "error in " << script << ": " << e.what() << std::endl;
       return 1;
     }
 
@@ -98,6 +156,18 @@ main(int argc, char **argv)
         break;
 
       switch (c) {
+      case 'e':
+        if (!option_values.add("expression", optarg)) {
+          std::cerr << "invalid expression " << optarg << std::endl;
+          return 1;
+        }
+        break;
+      case 'o':
+        if (!option_values.add("output", optarg)) {
+          std::cerr << "invalid output plugin " << optarg << std::endl;
+          return 1;
+        }
+        break;
       case 'D': {
         std::string arg(optarg);
         if (arg.size() > 2 && arg.substr(0, 2) == "0x") {
@@ -109,22 +179,106 @@ main(int argc, char **argv)
           askr::debug::gLevel.set(std::stoi(optarg));
         }
       } break;
+      case 'J':
+        option_values.add("jit", "true");
+        break;
       case 'V':
         verbose_flag = true;
         break;
+      case 'S': {
+        char *end;
+        unsigned long interval = optarg ? strtoul(optarg, &end, 10) : 0;
+
+        if (optarg && (*end || *optarg == '-')) {
+          std::cerr << "invalid stats interval " << optarg << std::endl;
+          return 1;
+        }
+        option_values.add("stats", std::to_string(interval));
+      } break;
+      case 'M': {
+        size_t limit = parse_size(optarg);
+
+        if (limit == 0) {
+          std::cerr << "invalid memory size " << optarg << std::endl;
+          return 1;
+        }
+        if (limit < MIN_MEMORY) {
+          std::cerr << "memory size " << optarg << " is below the minimum of " << (MIN_MEMORY >> 20)
+                    << "M, half of which are the input buffers" << std::endl;
+          return 1;
+        }
+        option_values.add("max-memory", std::to_string(limit));
+      } break;
+      case 'P':
+        prefault_flag = true;
+        break;
+      case 't': {
+        char *end;
+
+        threads = strtoul(optarg, &end, 10);
+        if (*end || threads < 1 || threads > MAX_THREADS) {
+          std::cerr << "invalid number of threads " << optarg << std::endl;
+          return 1;
+        }
+      } break;
       case 'H':
         askr_options.print_help();
-        break;
+        return 0;
+      case '?':
+        // getopt_long() has already complained about it
+        return 1;
       default:
-        // ToDo: Here we have to deal with all the "custom" options for the plugins used
+        // These are the "custom" options of the script, which are used by the plugins via their names
+        for (auto const &opt : askr_options) {
+          if (opt.short_opt() == c && !opt.name().empty()) {
+            if (!option_values.add(opt.name(), optarg ? optarg : "true")) {
+              std::cerr << "invalid value for option -" << static_cast<char>(c) << std::endl;
+              return 1;
+            }
+            break;
+          }
+        }
         break;
       }
     }
+
+    if ((askr::debug::gLevel >> (ASKR_DEBUG_MAX_LEVEL + 1)).any()) {
+      std::cerr << "debug levels above " << ASKR_DEBUG_MAX_LEVEL << " are compiled out of this build" << std::endl;
+    }
+
+    // Setup the pool of Buffer chunks that the reader parses into. This is mapped (and optionally pre-faulted)
+    // up front, such that there are no allocations or page faults on the hot path. With --max-memory, the pool
+    // gets half of it, and the reader waits for chunks to be released once they are all in flight.
+    std::unique_ptr<askr::BufferPool> pool;
+    size_t num_chunks = askr::BufferPool::DEFAULT_NUM_CHUNKS;
+
+    if (auto const &limit = option_values.get("max-memory"); !limit.empty()) {
+      num_chunks = std::clamp<size_t>(std::stoull(limit.back()) / 2 / askr::BufferPool::DEFAULT_CHUNK_SIZE, MIN_CHUNKS, num_chunks);
+    }
+
+    try {
+      pool = std::make_unique<askr::BufferPool>(askr::BufferPool::DEFAULT_CHUNK_SIZE, num_chunks, prefault_flag);
+    } catch (std::exception &e) {
+      std::cerr << "error setting up the buffer pool: " << e.what() << std::endl;
+      return 1;
+    }
+
+    // The first non-option argument is the script itself, everything after that are the input files
+    std::vector<std::string> files(argv + std::min(optind + 1, argc), argv + argc);
+
+    try {
+      askr::Pipeline pipeline(config, option_values, threads);
+
+      pipeline.run(files, *pool);
+    } catch (std::exception &e) {
+      std::cerr << "error in " << script << ": " << e.what() << std::endl;
+      return 1;
+    }
   } else {
     std::cerr << "Insufficient arguments";
   }
   // Dump jemalloc data, very verbose!
-  if (askr::debug::Do(askr::debug::MEMORY)) {
+  if (askr::debug::Do<askr::debug::MEMORY>()) {
     std::cerr << "jemalloc stats : " << std::endl;
     malloc_stats_print(NULL, NULL, NULL);
   }
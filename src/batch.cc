@@ -0,0 +1,71 @@
+/**
+ * @file
+ * @brief Implementation details for the columnar record batch
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include "askr/batch.h"
+#include "askr/plugin.h"
+#include "gsl/gsl"
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class RecordBatch
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  RecordBatch::RecordBatch(std::shared_ptr<Buffer> buffer, const Projection &projection, const Reader *reader)
+    : buffer_(std::move(buffer)), projection_(projection), reader_(reader)
+  {
+    Expects(buffer_);
+
+    columns_.reserve(projection_.keys().size());
+    for (auto key : projection_.keys()) {
+      add_column(key);
+    }
+  }
+
+  Column &
+  RecordBatch::add_column(KeyId key)
+  {
+    if (key >= index_.size()) {
+      index_.resize(key + 1, -1);
+    }
+    if (index_[key] < 0) {
+      index_[key] = gsl::narrow_cast<int32_t>(columns_.size());
+      columns_.emplace_back(key);
+    }
+
+    return columns_[index_[key]];
+  }
+
+  bool
+  RecordBatch::is_json(size_t row, std::string_view value) const
+  {
+    return reader_->is_json(record(row), value);
+  }
+
+  void
+  RecordBatch::set_layout(std::shared_ptr<const std::vector<KeyId>> keys)
+  {
+    layout_keys_ = std::move(keys);
+    layout_.clear();
+    if (layout_keys_) {
+      layout_.reserve(layout_keys_->size());
+      for (auto key : *layout_keys_) {
+        layout_.push_back((key < index_.size() && index_[key] >= 0) ? index_[key] : NO_COLUMN);
+      }
+    }
+  }
+
+} // namespace askr
@@ -0,0 +1,173 @@
+/**
+ * @file
+ * @brief Implementation details for the Buffer and BufferPool classes
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <algorithm>
+#include <iostream>
+#include <system_error>
+#include <cerrno>
+#include <cstdint>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "askr/askr.h"
+#include "askr/buffers.h"
+#include "gsl/gsl"
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class Buffer
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  Buffer::~Buffer()
+  {
+    pool_->release(data_);
+  }
+
+  char *
+  Buffer::allocate(size_t len)
+  {
+    if (char *space = scratch(len); space) {
+      commit(len);
+      return space;
+    }
+    allocated_.emplace_back(new char[len]);
+
+    return allocated_.back().get();
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class BufferPool
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // Map the entire pool, trying explicit huge pages first, then transparent huge pages.
+  BufferPool::BufferPool(size_t chunk_size, size_t num_chunks, bool prefault)
+    : chunk_size_(((chunk_size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE), num_chunks_(num_chunks)
+  {
+    Expects(chunk_size > 0 && num_chunks > 0);
+
+    size_t size = chunk_size_ * num_chunks_;
+    void *addr  = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (addr != MAP_FAILED) {
+      hugetlb_     = true;
+      mapped_size_ = size;
+      mapping_     = static_cast<char *>(addr);
+      base_        = mapping_;
+    }
+#endif
+
+    if (addr == MAP_FAILED) {
+      // Over-allocate by one huge page, such that the chunks can be aligned on a huge page boundary,
+      // otherwise the kernel can not back the first and last partial huge page with THP.
+      mapped_size_ = size + HUGE_PAGE_SIZE;
+      addr         = mmap(nullptr, mapped_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (addr == MAP_FAILED) {
+        throw std::system_error(errno, std::system_category(), "mmap() of the buffer pool failed");
+      }
+      mapping_ = static_cast<char *>(addr);
+      base_    = reinterpret_cast<char *>((reinterpret_cast<uintptr_t>(mapping_) + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+#ifdef MADV_HUGEPAGE
+      if (madvise(base_, size, MADV_HUGEPAGE) != 0 && askr::debug::Do<askr::debug::MEMORY>()) {
+        std::cerr << "BufferPool: madvise(MADV_HUGEPAGE) failed, using regular pages" << std::endl;
+      }
+#endif
+    }
+
+    if (askr::debug::Do<askr::debug::MEMORY>()) {
+      std::cerr << "BufferPool: mapped " << num_chunks_ << " chunks of " << chunk_size_ << " bytes, "
+                << (hugetlb_ ? "using MAP_HUGETLB" : "using transparent huge pages") << std::endl;
+    }
+
+    free_.reserve(num_chunks_);
+    for (size_t i = num_chunks_; i > 0; --i) {
+      free_.push_back(base_ + (i - 1) * chunk_size_);
+    }
+
+    if (prefault) {
+      this->prefault();
+    }
+  }
+
+  BufferPool::~BufferPool()
+  {
+    Expects(free_.size() == num_chunks_);
+    munmap(mapping_, mapped_size_);
+  }
+
+  // Hand out the most recently released chunk, it is the most likely one to still be warm in the caches.
+  std::shared_ptr<Buffer>
+  BufferPool::acquire(bool wait)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    if (wait) {
+      cond_.wait(lock, [this] { return !free_.empty(); });
+    } else if (free_.empty()) {
+      return {};
+    }
+
+    char *chunk = free_.back();
+
+    free_.pop_back();
+    peak_ = std::max(peak_, num_chunks_ - free_.size());
+
+    return std::make_shared<Buffer>(this, chunk, chunk_size_);
+  }
+
+  // Write one byte per (small) page, which works regardless of what page size the kernel decided to use.
+  void
+  BufferPool::prefault()
+  {
+    static const size_t page_size = sysconf(_SC_PAGESIZE);
+    volatile char *end            = base_ + chunk_size_ * num_chunks_;
+
+    for (volatile char *p = base_; p < end; p += page_size) {
+      *p = 0;
+    }
+  }
+
+  size_t
+  BufferPool::available() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return free_.size();
+  }
+
+  size_t
+  BufferPool::peak() const
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    return peak_;
+  }
+
+  void
+  BufferPool::release(char *chunk)
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      free_.push_back(chunk);
+    }
+    cond_.notify_one();
+  }
+
+} // namespace askr
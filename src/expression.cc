@@ -0,0 +1,366 @@
+/**
+ * @file
+ * @brief Implementation details for the query expressions (-e) filter
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <cctype>
+#include <cstdio>
+#include <stdexcept>
+
+#include "expression.h"
+#include "gsl/gsl"
+
+namespace
+{
+  template <class T>
+  bool
+  compare(askr::Expression::Op op, const T &lhs, const T &rhs)
+  {
+    switch (op) {
+    case askr::Expression::EQ:
+      return lhs == rhs;
+    case askr::Expression::NE:
+      return lhs != rhs;
+    case askr::Expression::LT:
+      return lhs < rhs;
+    case askr::Expression::LE:
+      return lhs <= rhs;
+    case askr::Expression::GT:
+      return lhs > rhs;
+    case askr::Expression::GE:
+      return lhs >= rhs;
+    }
+    return false;
+  }
+
+  bool
+  match(const askr::Expression::Condition &cond, const askr::RecordBatch &batch, uint32_t row)
+  {
+    // A numeric condition never matches a value that is not a number, or is NaN, other than for !=
+    if (cond.typed.is_number()) {
+      askr::TypedValue typed = batch.typed(cond.key, row);
+      int res                = typed.is_number() ? typed.compare(cond.typed) : askr::TypedValue::UNORDERED;
+
+      return res == askr::TypedValue::UNORDERED ? cond.op == askr::Expression::NE : compare(cond.op, res, 0);
+    }
+
+    std::string_view value = batch.value(cond.key, row);
+
+    if (!value.data()) {
+      return cond.op == askr::Expression::NE;
+    }
+    return compare(cond.op, value, std::string_view(cond.value));
+  }
+
+  // The fixed part of the generated source: the column layout, which matches askr::Span and the null bitmap of
+  // askr::Column, and the condition templates, which the compiler specializes for the baked in constants.
+  const char JIT_PRELUDE[] = R"(#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace
+{
+  struct Span {
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  struct Column {
+    const Span *spans;
+    const uint64_t *valid;
+    size_t size;
+  };
+
+  using Numeric = int (*)(const void *, unsigned, uint32_t);
+
+  enum Op { EQ, NE, LT, LE, GT, GE };
+
+  template <int OP, class T>
+  inline bool
+  compare(T lhs, T rhs)
+  {
+    switch (OP) {
+    case EQ:
+      return lhs == rhs;
+    case NE:
+      return lhs != rhs;
+    case LT:
+      return lhs < rhs;
+    case LE:
+      return lhs <= rhs;
+    case GT:
+      return lhs > rhs;
+    default:
+      return lhs >= rhs;
+    }
+  }
+
+  inline bool
+  present(const Column &col, uint32_t row)
+  {
+    return row < col.size && ((col.valid[row >> 6] >> (row & 63)) & 1);
+  }
+
+  // The same as std::from_chars(), for up to 18 digits. Anything else is left to the full decoder.
+  inline bool
+  integer(const char *p, uint32_t len, int64_t &val)
+  {
+    bool neg    = len > 0 && *p == '-';
+    int64_t res = 0;
+
+    p += neg;
+    len -= neg;
+    if (len == 0 || len > 18) {
+      return false;
+    }
+    for (uint32_t i = 0; i < len; ++i) {
+      unsigned d = static_cast<unsigned char>(p[i]) - '0';
+
+      if (d > 9) {
+        return false;
+      }
+      res = res * 10 + d;
+    }
+    val = neg ? -res : res;
+    return true;
+  }
+
+  template <int OP, size_t N>
+  inline bool
+  string_condition(const char *base, const Column &col, uint32_t row, const char (&lit)[N])
+  {
+    constexpr uint32_t len = N - 1;
+
+    if (!present(col, row)) {
+      return OP == NE;
+    }
+
+    const Span span = col.spans[row];
+
+    if (OP == EQ || OP == NE) {
+      return (span.length == len && memcmp(base + span.offset, lit, len) == 0) == (OP == EQ);
+    }
+
+    int res = memcmp(base + span.offset, lit, span.length < len ? span.length : len);
+
+    return compare<OP>(res ? res : (span.length > len) - (span.length < len), 0);
+  }
+
+  template <int OP>
+  inline bool
+  numeric_condition(int res)
+  {
+    return res == 2 ? OP == NE : compare<OP>(res, 0);
+  }
+
+  template <int OP, int64_t VAL>
+  inline bool
+  integer_condition(const char *base, const Column &col, uint32_t row, Numeric numeric, const void *ctx, unsigned cond)
+  {
+    int64_t val;
+
+    if (!present(col, row)) {
+      return OP == NE;
+    }
+    if (integer(base + col.spans[row].offset, col.spans[row].length, val)) {
+      return compare<OP>(val, VAL);
+    }
+    return numeric_condition<OP>(numeric(ctx, cond, row));
+  }
+} // namespace
+)";
+
+  // The column layout of the generated code
+  struct JitColumn {
+    const askr::Span *spans;
+    const uint64_t *valid;
+    size_t size;
+  };
+
+  struct JitContext {
+    const askr::Expression *expression;
+    const askr::RecordBatch *batch;
+  };
+
+  static_assert(sizeof(askr::Span) == 2 * sizeof(uint32_t), "the JIT assumes a packed Span");
+
+  // The generated code calls back for the numeric conditions it can not decode itself. Returns the three-way
+  // comparison, or 2 (TypedValue::UNORDERED) if the value is not a number.
+  int
+  jit_numeric(const void *context, unsigned cond, uint32_t row)
+  {
+    auto ctx               = static_cast<const JitContext *>(context);
+    auto const &condition  = ctx->expression->conditions()[cond];
+    askr::TypedValue typed = ctx->batch->typed(condition.key, row);
+
+    return typed.is_number() ? typed.compare(condition.typed) : askr::TypedValue::UNORDERED;
+  }
+
+  // A C++ string literal, with everything but letters and digits escaped
+  std::string
+  literal(const std::string &str)
+  {
+    std::string res = "\"";
+
+    for (unsigned char c : str) {
+      if (isalnum(c)) {
+        res += c;
+      } else {
+        char oct[5];
+
+        snprintf(oct, sizeof(oct), "\\%03o", c);
+        res += oct;
+      }
+    }
+
+    return res + "\"";
+  }
+} // namespace
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class Expression
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void
+  Expression::setup(const YAML::Node &, const OptionValues &values)
+  {
+    for (auto const &expr : values.get("expression")) {
+      size_t pos = expr.find_first_of("=!<>");
+
+      if (pos == 0 || pos == std::string::npos) {
+        throw std::invalid_argument("invalid expression '" + expr + "', expected key<op>value");
+      }
+
+      Condition cond;
+      std::string_view op(expr.c_str() + pos, expr[pos + 1] == '=' ? 2 : 1);
+
+      if (op == "=" || op == "==") {
+        cond.op = EQ;
+      } else if (op == "!=") {
+        cond.op = NE;
+      } else if (op == "<") {
+        cond.op = LT;
+      } else if (op == "<=") {
+        cond.op = LE;
+      } else if (op == ">") {
+        cond.op = GT;
+      } else if (op == ">=") {
+        cond.op = GE;
+      } else {
+        throw std::invalid_argument("invalid operator in expression '" + expr + "'");
+      }
+      cond.key     = askr::keys::intern(std::string_view(expr).substr(0, pos));
+      cond.value   = expr.substr(pos + op.size());
+      cond.typed   = TypedValue::parse(cond.value);
+      conditions_.push_back(std::move(cond));
+    }
+
+    if (!values.get("jit").empty() && !conditions_.empty()) {
+      module_ = JitModule::compile(generate());
+      jit_    = reinterpret_cast<JitFilter>(module_->symbol("askr_jit_filter"));
+    }
+  }
+
+  void
+  Expression::columns(Projection &projection) const
+  {
+    for (auto const &cond : conditions_) {
+      projection.add(cond.key);
+    }
+  }
+
+  // Evaluate one condition at a time, over the whole selection. Each pass scans just one column. The compiled
+  // conditions instead make a single pass over the selection, for all the conditions.
+  void
+  Expression::process(RecordBatch &batch)
+  {
+    if (jit_) {
+      std::vector<JitColumn> columns;
+      std::vector<uint32_t> selection(batch.selection());
+      JitContext ctx = {this, &batch};
+
+      columns.reserve(conditions_.size());
+      for (auto const &cond : conditions_) {
+        const Column *col = batch.column(cond.key);
+
+        Expects(col); // All the keys are projected
+        columns.push_back({col->spans().data(), col->valid().data(), col->spans().size()});
+      }
+      selection.resize(jit_(batch.buffer()->data(), columns.data(), jit_numeric, &ctx, selection.data(), selection.size()));
+      batch.select(std::move(selection));
+      return;
+    }
+
+    for (auto const &cond : conditions_) {
+      std::vector<uint32_t> selection;
+
+      selection.reserve(batch.selection().size());
+      for (auto row : batch.selection()) {
+        if (match(cond, batch, row)) {
+          selection.push_back(row);
+        }
+      }
+      batch.select(std::move(selection));
+    }
+  }
+
+  // The conditions are chained with &&, such that the compiler can order and vectorize them as it sees fit. The
+  // selection is compacted without branches.
+  std::string
+  Expression::generate() const
+  {
+    std::string source = JIT_PRELUDE;
+
+    source += "\nextern \"C\" size_t\n"
+              "askr_jit_filter(const char *base, const void *columns, Numeric numeric, const void *ctx, uint32_t *selection, "
+              "size_t size)\n"
+              "{\n"
+              "  const Column *cols = static_cast<const Column *>(columns);\n"
+              "  size_t out         = 0;\n\n"
+              "  for (size_t ix = 0; ix < size; ++ix) {\n"
+              "    const uint32_t row = selection[ix];\n"
+              "    const bool pass    = true";
+
+    for (size_t ix = 0; ix < conditions_.size(); ++ix) {
+      auto const &cond = conditions_[ix];
+      std::string op   = std::to_string(cond.op);
+      std::string col  = "cols[" + std::to_string(ix) + "]";
+
+      source += "\n      && ";
+      if (cond.typed.type() == TypedValue::INTEGER) {
+        char val[64];
+
+        snprintf(val, sizeof(val), "static_cast<int64_t>(UINT64_C(0x%llx))",
+                 static_cast<unsigned long long>(cond.typed.as_integer()));
+        source += "integer_condition<" + op + ", " + val + ">(base, " + col + ", row, numeric, ctx, " + std::to_string(ix) + ")";
+      } else if (cond.typed.is_number()) {
+        source += "numeric_condition<" + op + ">(numeric(ctx, " + std::to_string(ix) + ", row))";
+      } else {
+        source += "string_condition<" + op + ">(base, " + col + ", row, " + literal(cond.value) + ")";
+      }
+    }
+
+    source += ";\n\n"
+              "    selection[out] = row;\n"
+              "    out += pass;\n"
+              "  }\n\n"
+              "  return out;\n"
+              "}\n";
+
+    return source;
+  }
+
+} // namespace askr
@@ -0,0 +1,105 @@
+/**
+ * @file
+ * @brief Include file for the query expressions (-e) filter
+ *
+ * This is not a public API.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "askr/plugin.h"
+#include "jit.h"
+
+namespace askr
+{
+/**
+ * @class Expression
+ * @brief The built-in filter for the -e query expressions, e.g. "status>=500,method=GET".
+ *
+ * Each expression is a single condition, "key<op>value", where op is one of =, ==, !=, <, <=, > or >=. Multiple
+ * expressions (comma separated, or multiple -e options) must all be true for a record to pass. When both the
+ * value in the expression and the value of the record are numbers (or time stamps), they are compared as such,
+ * using the decoded values cached in the batch, otherwise as strings. A record that does not have the key, or
+ * has a non-numeric value for a numeric condition, only passes the != condition.
+ *
+ * With the --jit option, all the conditions are generated as C++ code, with the columns, the literals and the
+ * integer constants baked in, and compiled into a single function that filters the selection in one pass. The
+ * interpreter remains the reference, and the generated code calls back into it for anything but integers.
+ */
+class Expression : public Filter
+{
+public:
+    /**
+     * @brief The comparison operators.
+     */
+    enum Op { EQ, NE, LT, LE, GT, GE };
+
+    /**
+     * @brief One parsed condition.
+     */
+    struct Condition {
+        KeyId key = INVALID_KEY;
+        Op op     = EQ;
+        std::string value;
+        TypedValue typed; /**< The decoded value, numeric conditions compare against this */
+    };
+
+    /**
+     * @brief The signature of the generated filter function, see generate().
+     */
+    using JitFilter = size_t (*)(const char *base, const void *columns, int (*numeric)(const void *, unsigned, uint32_t),
+                                 const void *context, uint32_t *selection, size_t size);
+
+    /**
+     * @brief Parse all the -e expressions, this throws std::invalid_argument on syntax errors. With --jit, the
+     * conditions are compiled as well, which throws std::runtime_error if that fails.
+     *
+     * @param node     Not used, the expressions are not configured in the script
+     * @param values   The command line option values, the expressions are under the "expression" name
+     */
+    void setup(const YAML::Node &node, const OptionValues &values) override;
+
+    void columns(Projection &projection) const override;
+
+    void process(RecordBatch &batch) override;
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  All the parsed conditions
+     */
+    const std::vector<Condition> &
+    conditions() const
+    {
+        return conditions_;
+    }
+
+    /**
+     * @brief Generate the C++ source of the filter function, for the JIT.
+     *
+     * @return  The complete source
+     */
+    std::string generate() const;
+
+private:
+    std::vector<Condition> conditions_;
+    std::shared_ptr<const JitModule> module_; /**< The compiled conditions, with --jit */
+    JitFilter jit_ = nullptr;
+};
+} // namespace askr
@@ -0,0 +1,165 @@
+/**
+ * @file
+ * @brief Include file for the log-linear (HDR style) latency histograms of the pipeline statistics
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace askr
+{
+/**
+ * @class Histogram
+ * @brief A log-linear histogram of values, typically nanoseconds, with a bounded relative error.
+ *
+ * Every power of two is split into SUB linear buckets, so a value is recorded with an error of at most 1 / SUB
+ * (6.25%), over the entire 64-bit range, in a fixed array of counters. Recording is a couple of instructions and
+ * never allocates or locks.
+ *
+ * A histogram has a single writer at a time, typically one histogram per thread, which are merged when reported.
+ * The counters are relaxed atomics, so that they can be read (and merged) while the writer is recording.
+ */
+class Histogram
+{
+public:
+    static constexpr unsigned SUB_BITS = 4;                          /**< log2 of the buckets per power of two */
+    static constexpr uint64_t SUB      = uint64_t(1) << SUB_BITS;     /**< Buckets per power of two */
+    static constexpr size_t BUCKETS    = (64 - SUB_BITS + 1) * SUB;   /**< Buckets for the entire 64-bit range */
+
+    /**
+     * @brief Record a value. Only one thread at a time may record into a histogram.
+     *
+     * @param value   The value, e.g. a duration in nanoseconds
+     */
+    void
+    record(uint64_t value)
+    {
+        auto &bucket = counts_[index(value)];
+
+        // Single writer, so this needs no locked read-modify-write
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        count_.store(count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        if (value > max_.load(std::memory_order_relaxed)) {
+            max_.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Add all the values of another histogram to this one, used when reporting.
+     *
+     * @param other   The histogram to merge, which can be recording concurrently
+     */
+    void
+    merge(const Histogram &other)
+    {
+        uint64_t count = 0;
+
+        for (size_t ix = 0; ix < BUCKETS; ++ix) {
+            uint64_t n = other.counts_[ix].load(std::memory_order_relaxed);
+
+            counts_[ix].fetch_add(n, std::memory_order_relaxed);
+            count += n;
+        }
+        count_.fetch_add(count, std::memory_order_relaxed);
+        if (uint64_t max = other.max_.load(std::memory_order_relaxed); max > max_.load(std::memory_order_relaxed)) {
+            max_.store(max, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Get a percentile of the recorded values.
+     *
+     * @param percentile   The percentile, 0 - 100
+     * @return             The value at the percentile, the midpoint of its bucket, or 0 if nothing was recorded
+     */
+    uint64_t
+    percentile(double percentile) const
+    {
+        uint64_t count = count_.load(std::memory_order_relaxed);
+        uint64_t rank  = static_cast<uint64_t>(percentile / 100.0 * count + 0.5);
+        uint64_t seen  = 0;
+
+        for (size_t ix = 0; ix < BUCKETS; ++ix) {
+            seen += counts_[ix].load(std::memory_order_relaxed);
+            if (seen > 0 && seen >= rank) {
+                uint64_t low = lowest(ix), high = lowest(ix + 1) - 1;
+                uint64_t max = max_.load(std::memory_order_relaxed);
+
+                return std::min(low + (high - low) / 2, max);
+            }
+        }
+
+        return 0;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The number of recorded values
+     */
+    uint64_t
+    count() const
+    {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The largest recorded value
+     */
+    uint64_t
+    max() const
+    {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+private:
+    // Values below SUB have a bucket each, above that the bucket is the magnitude plus the SUB_BITS next bits
+    static size_t
+    index(uint64_t value)
+    {
+        if (value < SUB) {
+            return value;
+        }
+
+        unsigned shift = 63 - __builtin_clzll(value) - SUB_BITS;
+
+        return (shift + 1) * SUB + ((value >> shift) & (SUB - 1));
+    }
+
+    // The smallest value of a bucket, the inverse of index()
+    static uint64_t
+    lowest(size_t ix)
+    {
+        if (ix < SUB) {
+            return ix;
+        }
+        if (ix >= BUCKETS) {
+            return UINT64_MAX;
+        }
+
+        return (SUB + ix % SUB) << (ix / SUB - 1);
+    }
+
+    std::array<std::atomic<uint64_t>, BUCKETS> counts_ = {};
+    std::atomic<uint64_t> count_                      = 0;
+    std::atomic<uint64_t> max_                        = 0;
+};
+} // namespace askr
@@ -0,0 +1,182 @@
+/**
+ * @file
+ * @brief Implementation details for the JIT modules
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <chrono>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "askr/askr.h"
+#include "jit.h"
+#include "gsl/gsl"
+
+#ifndef ASKR_JIT_CXX
+#define ASKR_JIT_CXX "c++"
+#endif
+
+namespace
+{
+  std::mutex gMutex;
+  std::map<std::string, std::weak_ptr<const askr::JitModule>> gModules;
+
+  // The compiler, and what it said, of a failed compilation
+  std::string
+  compiler_output(const std::string &path)
+  {
+    std::ifstream file(path);
+    std::stringstream output;
+
+    output << file.rdbuf();
+
+    std::string res = output.str();
+
+    return res.size() > 1024 ? res.substr(0, 1024) + "..." : res;
+  }
+
+  // Run the compiler, with its output to the log. The compiler setting is split into words, so it can have options
+  // (e.g. "ccache c++"), but nothing is interpreted by a shell. Returns false if it did not succeed.
+  bool
+  run_compiler(const std::string &cxx, const std::vector<std::string> &args, const std::string &log, std::string &command)
+  {
+    std::vector<std::string> words;
+    std::istringstream split(cxx);
+
+    for (std::string word; split >> word;) {
+      words.push_back(word);
+    }
+    words.insert(words.end(), args.begin(), args.end());
+
+    std::vector<char *> argv;
+
+    for (auto &word : words) {
+      argv.push_back(word.data());
+      command += (command.empty() ? "" : " ") + word;
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    pid_t pid;
+    int status = -1;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+
+    int rc = words.empty() ? EINVAL : posix_spawnp(&pid, argv[0], &actions, nullptr, argv.data(), environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    if (rc != 0) {
+      command += std::string(": ") + strerror(rc);
+      return false;
+    }
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+} // namespace
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class JitModule
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  JitModule::~JitModule()
+  {
+    dlclose(handle_);
+  }
+
+  std::shared_ptr<const JitModule>
+  JitModule::compile(const std::string &source)
+  {
+    std::lock_guard<std::mutex> lock(gMutex);
+
+    if (auto module = gModules[source].lock(); module) {
+      return module;
+    }
+
+    const char *tmp = getenv("TMPDIR");
+    std::string dir = std::string(tmp && *tmp ? tmp : "/tmp") + "/askr-jit.XXXXXX";
+
+    if (!mkdtemp(dir.data())) {
+      throw std::runtime_error("can not create a directory for the JIT: " + dir);
+    }
+
+    std::string src = dir + "/module.cc", lib = dir + "/module.so", log = dir + "/module.log";
+    auto cleanup    = gsl::finally([&] {
+      unlink(src.c_str());
+      unlink(lib.c_str());
+      unlink(log.c_str());
+      rmdir(dir.c_str());
+    });
+
+    std::ofstream(src) << source;
+
+    const char *cxx = getenv("ASKR_JIT_CXX");
+    std::string command;
+    auto start = std::chrono::steady_clock::now();
+
+    if (!run_compiler(cxx && *cxx ? cxx : ASKR_JIT_CXX, {"-std=c++17", "-O3", "-march=native", "-fPIC", "-shared", "-o", lib, src},
+                      log, command)) {
+      throw std::runtime_error("JIT compilation failed: " + command + "\n" + compiler_output(log));
+    }
+
+    // The library can be unlinked once loaded, the mapping keeps it alive
+    void *handle = dlopen(lib.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+    if (!handle) {
+      throw std::runtime_error(std::string("can not load the JIT module: ") + dlerror());
+    }
+    if (askr::debug::Do<askr::debug::BASIC>()) {
+      auto msec = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+
+      std::cerr << "JIT: compiled a module of " << source.size() << " bytes in " << msec << "ms" << std::endl;
+    }
+
+    std::shared_ptr<const JitModule> module(new JitModule(handle));
+
+    gModules[source] = module;
+
+    return module;
+  }
+
+  void *
+  JitModule::symbol(const char *name) const
+  {
+    void *sym = dlsym(handle_, name);
+
+    if (!sym) {
+      throw std::runtime_error(std::string("the JIT module has no symbol ") + name);
+    }
+
+    return sym;
+  }
+
+} // namespace askr
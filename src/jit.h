@@ -0,0 +1,66 @@
+/**
+ * @file
+ * @brief Include file for the JIT, compiling generated C++ into a shared object and loading it
+ *
+ * This is not a public API.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+
+namespace askr
+{
+/**
+ * @class JitModule
+ * @brief A shared object compiled from generated source, with the local C++ compiler.
+ *
+ * The compiler is the one askr was configured with, or $ASKR_JIT_CXX. It is run without a shell, and the words of
+ * the compiler setting are split on spaces, e.g. "ccache c++", without any quoting. The source is written to a
+ * private temporary directory, compiled and loaded with dlopen(), after which the directory is removed again.
+ * Modules are cached by their source, such that the worker threads all share a single compilation.
+ */
+class JitModule
+{
+public:
+    JitModule(const JitModule &) = delete;
+    JitModule &operator=(const JitModule &) = delete;
+
+    ~JitModule();
+
+    /**
+     * @brief Compile and load generated source, or get the already loaded module for the same source. This
+     * throws std::runtime_error if the source can not be compiled or loaded.
+     *
+     * @param source   The complete C++ source of the module
+     * @return         The loaded module
+     */
+    static std::shared_ptr<const JitModule> compile(const std::string &source);
+
+    /**
+     * @brief Lookup a symbol in the module, throws std::runtime_error if it does not exist.
+     *
+     * @param name   The (extern "C") name of the symbol
+     * @return       The address of the symbol
+     */
+    void *symbol(const char *name) const;
+
+private:
+    explicit JitModule(void *handle) : handle_(handle) {}
+
+    void *handle_;
+};
+} // namespace askr
@@ -17,3 +17,88 @@
  */
 
 #include "askr/keyvals.h"
+#include "askr/plugin.h"
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class KeyValueStore
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // Tokenize one more field, returns false when the record is exhausted.
+  bool
+  KeyValueStore::next() const
+  {
+    while (pos_ != std::string_view::npos) {
+      Field field;
+
+      pos_ = reader_->next_field(*buffer_, record_, pos_, field.first, field.second);
+      if (field.first.data()) {
+        fields_.push_back(field);
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  // Find the index of a key in the fields, tokenizing as necessary. Returns fields_.size() if not found.
+  size_t
+  KeyValueStore::index(std::string_view key) const
+  {
+    for (size_t ix = 0; ix < fields_.size(); ++ix) {
+      if (fields_[ix].first == key) {
+        return ix;
+      }
+    }
+    while (next()) {
+      if (fields_.back().first == key) {
+        return fields_.size() - 1;
+      }
+    }
+
+    return fields_.size();
+  }
+
+  std::string_view
+  KeyValueStore::find(std::string_view key) const
+  {
+    size_t ix = index(key);
+
+    return ix < fields_.size() ? fields_[ix].second : std::string_view{};
+  }
+
+  TypedValue
+  KeyValueStore::typed(std::string_view key) const
+  {
+    size_t ix = index(key);
+
+    if (ix >= fields_.size()) {
+      return TypedValue::parse({});
+    }
+    if (ix >= typed_.size()) {
+      typed_.resize(fields_.size());
+    }
+    if (typed_[ix].type() == TypedValue::UNPARSED) {
+      typed_[ix] = TypedValue::parse(fields_[ix].second);
+    }
+
+    return typed_[ix];
+  }
+
+  const std::vector<Field> &
+  KeyValueStore::fields() const
+  {
+    while (next()) {
+    }
+
+    return fields_;
+  }
+
+  bool
+  KeyValueStore::is_json(std::string_view value) const
+  {
+    return reader_->is_json(record_, value);
+  }
+
+} // namespace askr
@@ -0,0 +1,90 @@
+/**
+ * @file
+ * @brief Implementation details for the interned keys registry
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+
+#include "askr/keys.h"
+#include "gsl/gsl"
+
+namespace
+{
+  // The names are stored in a deque, which never moves its elements, such that the string_view keys of the
+  // map (and the views handed out by askr::keys::name()) remain valid forever.
+  std::shared_mutex gMutex;
+  std::deque<std::string> gNames;
+  std::unordered_map<std::string_view, askr::KeyId> gIds;
+} // namespace
+
+namespace askr
+{
+  namespace keys
+  {
+    KeyId
+    intern(std::string_view name)
+    {
+      if (KeyId id = find(name); id != INVALID_KEY) {
+        return id;
+      }
+
+      std::unique_lock<std::shared_mutex> lock(gMutex);
+
+      // Someone else might have beaten us to it, between the two locks
+      if (auto it = gIds.find(name); it != gIds.end()) {
+        return it->second;
+      }
+
+      KeyId id = gsl::narrow_cast<KeyId>(gNames.size());
+
+      gNames.emplace_back(name);
+      gIds.emplace(gNames.back(), id);
+
+      return id;
+    }
+
+    KeyId
+    find(std::string_view name)
+    {
+      std::shared_lock<std::shared_mutex> lock(gMutex);
+
+      if (auto it = gIds.find(name); it != gIds.end()) {
+        return it->second;
+      }
+      return INVALID_KEY;
+    }
+
+    std::string_view
+    name(KeyId id)
+    {
+      std::shared_lock<std::shared_mutex> lock(gMutex);
+
+      Expects(id < gNames.size());
+      return gNames[id];
+    }
+
+    size_t
+    size()
+    {
+      std::shared_lock<std::shared_mutex> lock(gMutex);
+
+      return gNames.size();
+    }
+  } // namespace keys
+} // namespace askr
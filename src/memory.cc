@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @brief Implementation details for the memory accounting of the pipeline
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <cstdio>
+
+#include <jemalloc/jemalloc.h>
+
+#include "memory.h"
+
+namespace
+{
+  // jemalloc's counters of the calling thread, looked up once per thread. These are plain loads after that.
+  struct ThreadCounters {
+    ThreadCounters()
+    {
+      size_t len = sizeof(uint64_t *);
+
+      if (mallctl("thread.allocatedp", &allocated, &len, nullptr, 0) != 0 ||
+          mallctl("thread.deallocatedp", &deallocated, &len, nullptr, 0) != 0) {
+        allocated = deallocated = nullptr;
+      }
+    }
+
+    uint64_t *allocated   = nullptr;
+    uint64_t *deallocated = nullptr;
+  };
+
+  const ThreadCounters &
+  counters()
+  {
+    thread_local ThreadCounters counters;
+
+    return counters;
+  }
+
+  // A gauge as "name":bytes,"name_peak":bytes
+  std::string
+  gauge(const char *name, const askr::Gauge &gauge)
+  {
+    char buf[128];
+
+    snprintf(buf, sizeof(buf), ",\"%s\":%lld,\"%s_peak\":%lld", name, static_cast<long long>(gauge.current()), name,
+             static_cast<long long>(gauge.peak()));
+
+    return buf;
+  }
+} // namespace
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class Memory
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  int64_t
+  Memory::thread_heap()
+  {
+    auto const &thread = counters();
+
+    return thread.allocated ? static_cast<int64_t>(*thread.allocated - *thread.deallocated) : 0;
+  }
+
+  bool
+  Memory::heap_available()
+  {
+    return counters().allocated != nullptr;
+  }
+
+  // The statistics are only refreshed when the epoch is advanced
+  int64_t
+  Memory::heap()
+  {
+    uint64_t epoch = 1;
+    size_t allocated;
+    size_t len = sizeof(epoch);
+
+    if (mallctl("epoch", &epoch, &len, &epoch, len) != 0) {
+      return -1;
+    }
+    len = sizeof(allocated);
+    if (mallctl("stats.allocated", &allocated, &len, nullptr, 0) != 0) {
+      return -1;
+    }
+
+    return allocated;
+  }
+
+  size_t
+  Memory::used() const
+  {
+    int64_t allocated = heap();
+
+    return (pool_.num_chunks() - pool_.available()) * pool_.chunk_size() + (allocated > 0 ? allocated : 0);
+  }
+
+  std::string
+  Memory::json(const char *kind, double elapsed) const
+  {
+    int64_t allocated = heap();
+    std::string limit = limit_ > 0 ? std::to_string(limit_) : "null";
+    std::string total = allocated >= 0 ? std::to_string(allocated) : "null";
+    char buf[512];
+
+    snprintf(buf, sizeof(buf),
+             "{\"stats\":\"%s\",\"elapsed\":%.3f,\"memory\":\"pipeline\",\"limit\":%s,\"heap\":%s,\"pool\":%zu,"
+             "\"pool_in_use\":%zu,\"pool_peak\":%zu",
+             kind, elapsed, limit.c_str(), total.c_str(), pool_.num_chunks() * pool_.chunk_size(),
+             (pool_.num_chunks() - pool_.available()) * pool_.chunk_size(), pool_.peak() * pool_.chunk_size());
+
+    std::string out = buf;
+
+    out += gauge("batches", batches_);
+    out += gauge("output", output_);
+    snprintf(buf, sizeof(buf), ",\"throttled\":%llu}",
+             static_cast<unsigned long long>(throttled_.load(std::memory_order_relaxed)));
+
+    return out + buf;
+  }
+
+} // namespace askr
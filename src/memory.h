@@ -0,0 +1,201 @@
+/**
+ * @file
+ * @brief Include file for the memory accounting of the pipeline, and the --max-memory limit
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include "askr/buffers.h"
+
+namespace askr
+{
+/**
+ * @class Gauge
+ * @brief A number of bytes which goes up and down, and its peak. Any thread can update it.
+ */
+class Gauge
+{
+public:
+    /**
+     * @brief Account for bytes taken, or released with a negative delta.
+     *
+     * @param delta   The change in bytes
+     */
+    void
+    add(int64_t delta)
+    {
+        int64_t value = current_.fetch_add(delta, std::memory_order_relaxed) + delta;
+        int64_t peak  = peak_.load(std::memory_order_relaxed);
+
+        while (value > peak && !peak_.compare_exchange_weak(peak, value, std::memory_order_relaxed)) {
+        }
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The bytes currently accounted for
+     */
+    int64_t
+    current() const
+    {
+        return current_.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The most bytes accounted for at any one time
+     */
+    int64_t
+    peak() const
+    {
+        return peak_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<int64_t> current_ = 0;
+    std::atomic<int64_t> peak_    = 0;
+};
+
+/**
+ * @class Memory
+ * @brief The memory accounting of a pipeline, and the optional limit (--max-memory) on it.
+ *
+ * The memory that askr manages itself is accounted for directly: the BufferPool chunks in use, the input bytes
+ * pinned by the batches in flight, and the rendered output the ReorderBuffer holds until it can be written in
+ * order. What the plugins allocate comes from the heap, and is attributed to the plugin instances using jemalloc's
+ * per thread counters, see thread_heap().
+ *
+ * The limit is enforced with credits. Half of it sizes the BufferPool, whose chunks the reader must acquire, and
+ * a quarter is the budget of the output held by the ReorderBuffer, e.g. behind a slow consumer. Either one running
+ * out holds back the reader. On top of that, the limit applies to the chunks in use plus everything allocated from
+ * the heap. The reader checks it before every chunk, and when over the limit it lets the batches in flight drain
+ * before reading any more, rather than piling up more work. What the plugins hold on to can of course not be
+ * drained, so the limit is only as hard as the plugins' own state allows.
+ */
+class Memory
+{
+public:
+    Memory(const Memory &) = delete;
+    Memory &operator=(const Memory &) = delete;
+
+    /**
+     * @brief Construct a new Memory object.
+     *
+     * @param pool    The pool of Buffer chunks the reader reads into, which must outlive this
+     * @param limit   The limit in bytes, or 0 for no limit
+     */
+    Memory(const BufferPool &pool, size_t limit) : pool_(pool), limit_(limit) {}
+
+    /**
+     * @brief The bytes the calling thread allocated from the heap, minus what it freed. The difference of two
+     *        calls is what the code in between allocated and kept.
+     *
+     * @return  The net bytes allocated by the thread, always 0 without jemalloc's per thread counters
+     */
+    static int64_t thread_heap();
+
+    /**
+     * @brief Check if the per thread counters of thread_heap() are available.
+     *
+     * @return  True if they are
+     */
+    static bool heap_available();
+
+    /**
+     * @brief The bytes currently allocated from the heap, by all threads.
+     *
+     * @return  The allocated bytes, or -1 if jemalloc doesn't provide the statistics
+     */
+    static int64_t heap();
+
+    /**
+     * @brief The memory which the limit applies to, the chunks in use and the heap.
+     *
+     * @return  The bytes in use
+     */
+    size_t used() const;
+
+    /**
+     * @brief Check if the memory use is over the limit, in which case the check is counted as throttling the reader.
+     *
+     * @return  True if over the limit
+     */
+    bool
+    over()
+    {
+        if (limit_ == 0 || used() <= limit_) {
+            return false;
+        }
+        throttled_.fetch_add(1, std::memory_order_relaxed);
+
+        return true;
+    }
+
+    /**
+     * @brief Render the accounting as a JSON object, on one line.
+     *
+     * @param kind      What triggered the report, "interval" or "final"
+     * @param elapsed   The seconds since the pipeline started
+     * @return          The JSON object
+     */
+    std::string json(const char *kind, double elapsed) const;
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The input bytes of the batches in flight, from being read until they are rendered
+     */
+    Gauge &
+    batches()
+    {
+        return batches_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The rendered output held by the ReorderBuffer, waiting for earlier batches
+     */
+    Gauge &
+    output()
+    {
+        return output_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The limit in bytes, 0 if none
+     */
+    size_t
+    limit() const
+    {
+        return limit_;
+    }
+
+private:
+    const BufferPool &pool_;
+    size_t limit_;
+    Gauge batches_;
+    Gauge output_;
+    std::atomic<uint64_t> throttled_ = 0; /**< The number of times the reader was held back by the limit */
+};
+} // namespace askr
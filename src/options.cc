@@ -62,7 +62,10 @@ namespace askr
 
     Expects(getopts);
     for (auto const &opt : *this) {
-      getopts[ix++] = {opt.long_opt().c_str(), opt.has_arg(), nullptr, opt.short_opt()};
+      // Options without a long name are only available as short options
+      if (!opt.long_opt().empty()) {
+        getopts[ix++] = {opt.long_opt().c_str(), opt.has_arg(), nullptr, opt.short_opt()};
+      }
     }
     getopts[ix] = {nullptr, 0, nullptr, 0};
 
@@ -104,11 +107,26 @@ namespace askr
   // Implementation details for class OptionValues
   ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-  // Insert a new option value, after parsing it etc. properly
+  // Insert a new option value, splitting it on ','. Repeated options append to the existing values.
   bool
   OptionValues::add(const std::string &key, const std::string &str)
   {
-    options_[key] = {str}; // ToDo: Need the parsing here...
+    auto &values     = options_[key];
+    std::size_t prev = 0;
+
+    while (true) {
+      std::size_t pos = str.find(',', prev);
+      std::string val = str.substr(prev, pos == std::string::npos ? std::string::npos : pos - prev);
+
+      if (val.empty()) {
+        return false;
+      }
+      values.emplace_back(std::move(val));
+      if (pos == std::string::npos) {
+        break;
+      }
+      prev = pos + 1;
+    }
 
     return true;
   }
@@ -195,7 +213,7 @@ namespace YAML
     }
 
     // We have to use the init function here, to avoid construction another object
-    option.init(name, long_opt.substr(2), short_opt[1], description, has_arg);
+    option.init(name, long_opt.empty() ? long_opt : long_opt.substr(2), short_opt[1], description, has_arg);
 
     return true;
   }
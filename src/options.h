@@ -32,6 +32,7 @@
 #include <getopt.h>
 
 #include "askr/askr.h"
+#include "askr/option_values.h"
 #include "gsl/gsl"
 
 namespace askr
@@ -59,7 +60,7 @@ public:
      */
     Option()
     {
-        if (askr::debug::Do(askr::debug::CPP)) {
+        if (askr::debug::Do<askr::debug::CPP>()) {
             std::cerr << "Calling naked CTOR" << std::endl;
         }
     }
@@ -75,7 +76,7 @@ public:
     Option(const char *long_opt, char short_opt, const char *description, int has_arg)
         : long_opt_(long_opt), short_opt_(short_opt), description_(description), has_arg_(has_arg)
     {
-        if (askr::debug::Do(askr::debug::CPP)) {
+        if (askr::debug::Do<askr::debug::CPP>()) {
             std::cerr << "Option:Option(): calling C-style CTOR" << std::endl;
         }
     }
@@ -92,7 +93,7 @@ public:
     Option(const std::string &name, const std::string &long_opt, char short_opt, const std::string &description, int has_arg)
         : name_(name), long_opt_(long_opt), short_opt_(short_opt), description_(description), has_arg_(has_arg)
     {
-        if (askr::debug::Do(askr::debug::CPP)) {
+        if (askr::debug::Do<askr::debug::CPP>()) {
             std::cerr << "Option::Option(): calling C++-style CTOR" << std::endl;
         }
     }
@@ -106,7 +107,7 @@ public:
     void
     init(const std::string &name, const std::string &long_opt, char short_opt, const std::string &description, int has_arg)
     {
-        if (askr::debug::Do(askr::debug::CPP)) {
+        if (askr::debug::Do<askr::debug::CPP>()) {
             std::cout << "Option::init(): calling init function" << std::endl;
         }
 
@@ -243,50 +244,6 @@ public:
     void add_yaml(const YAML::Node &node);
 };
 
-/**
- * @class OptionValues
- * @brief Holds one, or more, values associated with a specific option
- *
- * Each stored option is a vector of strings. We always split the options on ',', as well as
- * multiple invocation of an option.
- */
-class OptionValues
-{
-public:
-    /**
-     * @brief Parse and add element(s) to the vector for the provided option (key)
-     *
-     * @param key The option name, which is the key into the hash
-     * @param str The string, possibly comma separated, to parse and add.
-     * @return true  On success
-     * @return false If any error during parsing / addition occured
-     */
-    bool add(const std::string &key, const std::string &str);
-
-    /**
-     * @brief Simple getter
-     *
-     * @param key The option name, which is the key into the hash
-     * @return The vector of value string values (possibly empty)
-     */
-    const std::vector<std::string> &get(const std::string &key) const;
-
-    /**
-     * @brief Simple getter
-     *
-     * @param key The option name, which is the key into the hash
-     * @return The vector of value string values (possibly empty)
-     */
-    const std::vector<std::string> &
-    get(const char *key) const
-    {
-        return get(std::string{key});
-    }
-
-private:
-    std::unordered_map<std::string, std::vector<std::string>> options_;
-};
-
 } // namespace askr
 
 namespace YAML
@@ -0,0 +1,493 @@
+/**
+ * @file
+ * @brief Implementation details for the processing pipeline
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <iostream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <system_error>
+#include <algorithm>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "pipeline.h"
+#include "expression.h"
+#include "yaml.h"
+#include "gsl/gsl"
+
+#ifndef ASKR_PLUGIN_DIR
+#define ASKR_PLUGIN_DIR "."
+#endif
+
+// These are the valid top level sections of a script
+static const std::vector<std::string> validSections = {"options", "input", "filter", "output"};
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class Pipeline
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  Pipeline::Pipeline(const YAML::Node &config, const OptionValues &values, size_t threads)
+  {
+    askr::yaml::basic_validation(config, validSections);
+
+    // The input section; exactly one reader is required
+    auto input = config["input"];
+
+    if (!input || !input.IsSequence() || input.size() != 1) {
+      throw YAML::ParserException(input ? input.Mark() : config.Mark(), "'input' must be a list with exactly one reader");
+    }
+    int64_t heap = Memory::thread_heap();
+
+    reader_ = load<Reader>(input[0], values);
+    heap    = Memory::thread_heap() - heap;
+
+    // The filter section is optional, and can have any number of filters
+    auto filter = config["filter"];
+
+    if (filter && !filter.IsSequence()) {
+      throw YAML::ParserException(filter.Mark(), "'filter' must be a list of filters");
+    }
+
+    // The output section; exactly one output is required, unless it's replaced with the -o option
+    YAML::Node output;
+
+    if (auto const &plugin = values.get("output"); !plugin.empty()) {
+      output["plugin"] = plugin.back();
+    } else if (auto section = config["output"]; section && section.IsSequence() && section.size() == 1) {
+      output = section[0];
+    } else {
+      throw YAML::ParserException(section ? section.Mark() : config.Mark(), "'output' must be a list with exactly one output");
+    }
+
+    sink_ = std::make_unique<Sink>(STDOUT_FILENO);
+
+    // The --stats counters, one set per plugin instance, in pipeline order
+    if (auto const &interval = values.get("stats"); !interval.empty()) {
+      stats_        = std::make_unique<Stats>(std::stoul(interval.back()));
+      reader_stats_ = &stats_->add("reader", input[0]["plugin"].as<std::string>(), 0, StageStats::NO_THREAD);
+      reader_stats_->heap(heap);
+    }
+    if (auto const &limit = values.get("max-memory"); !limit.empty()) {
+      max_memory_ = std::stoull(limit.back());
+    }
+
+    // Every thread gets its own instances of the filters and the output, so none of them need to be thread safe
+    workers_.resize(std::max<size_t>(threads, 1));
+    for (size_t thread = 0; thread < workers_.size(); ++thread) {
+      auto &worker = workers_[thread];
+      std::vector<std::string> names;
+      std::vector<int64_t> heaps; // What each instance allocated during its setup, the output being last
+
+      // The -e query expressions are the first filter, if any. They are cheap, and typically very selective.
+      if (!values.get("expression").empty()) {
+        auto expression = std::make_unique<Expression>();
+
+        heap = Memory::thread_heap();
+        expression->setup(config, values);
+        worker.filters.emplace_back(std::move(expression));
+        names.emplace_back("expression");
+        heaps.push_back(Memory::thread_heap() - heap);
+      }
+      if (filter) {
+        for (auto const &node : filter) {
+          heap = Memory::thread_heap();
+          worker.filters.emplace_back(load<Filter>(node, values));
+          names.emplace_back(node["plugin"].as<std::string>());
+          heaps.push_back(Memory::thread_heap() - heap);
+        }
+      }
+      heap          = Memory::thread_heap();
+      worker.output = load<Output>(output, values);
+      heaps.push_back(Memory::thread_heap() - heap);
+
+      if (stats_) {
+        for (size_t ix = 0; ix < names.size(); ++ix) {
+          worker.filter_stats.push_back(&stats_->add("filter", names[ix], ix + 1, thread));
+          worker.filter_stats.back()->heap(heaps[ix]);
+        }
+        worker.filter_heaps.resize(names.size());
+        worker.output_stats = &stats_->add("output", output["plugin"].as<std::string>(), names.size() + 1, thread);
+        worker.output_stats->heap(heaps.back());
+      }
+    }
+
+    // Now that everything is setup, collect the keys that the reader has to materialize. All the other fields
+    // are only tokenized on demand, for the records (and keys) that are actually used.
+    for (auto const &filter : workers_[0].filters) {
+      filter->columns(projection_);
+    }
+    workers_[0].output->columns(projection_);
+
+    if (askr::debug::Do<askr::debug::PLUGIN_SETUP>()) {
+      std::cerr << "Pipeline: " << workers_.size() << " thread(s), projected keys" << (projection_.all() ? " (all keys)" : "")
+                << std::endl;
+      for (auto key : projection_.keys()) {
+        std::cerr << "\t" << askr::keys::name(key) << std::endl;
+      }
+    }
+  }
+
+  Pipeline::~Pipeline()
+  {
+    stop();
+    workers_.clear();
+    reader_.reset();
+
+    for (auto handle : handles_) {
+      dlclose(handle);
+    }
+  }
+
+  // Load one plugin, which must implement the interface T, and set it up from its YAML node.
+  template <class T>
+  std::unique_ptr<T>
+  Pipeline::load(const YAML::Node &node, const OptionValues &values)
+  {
+    if (!node.IsMap() || !node["plugin"]) {
+      throw YAML::ParserException(node.Mark(), "'plugin' key is required");
+    }
+
+    std::string name = node["plugin"].as<std::string>();
+    const char *dir  = getenv("ASKR_PLUGIN_DIR"); // Mostly for running uninstalled builds, e.g. for make pgo
+    std::string path = (name.find('/') == std::string::npos) ? std::string(dir && *dir ? dir : ASKR_PLUGIN_DIR) + "/" + name : name;
+
+    // Plugins linked into the binary take precedence, anything else is loaded from its shared object
+    PluginFactory factory = (name.find('/') == std::string::npos) ? find_static_plugin(name) : nullptr;
+
+    if (factory) {
+      path = "(static) " + name;
+    } else {
+      void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+      if (!handle) {
+        throw YAML::ParserException(node["plugin"].Mark(), std::string("can not load plugin: ") + dlerror());
+      }
+      handles_.push_back(handle);
+
+      factory = reinterpret_cast<PluginFactory>(dlsym(handle, "askr_plugin_create"));
+      if (!factory) {
+        throw YAML::ParserException(node["plugin"].Mark(), "'" + name + "' is not an askr plugin");
+      }
+    }
+
+    std::unique_ptr<Plugin> plugin(factory());
+    T *typed = dynamic_cast<T *>(plugin.get());
+
+    if (!typed) {
+      throw YAML::ParserException(node["plugin"].Mark(), "'" + name + "' can not be used in this section");
+    }
+    plugin.release();
+
+    std::unique_ptr<T> res(typed);
+
+    if (askr::debug::Do<askr::debug::PLUGIN_SETUP>()) {
+      std::cerr << "Pipeline: loaded " << path << std::endl;
+    }
+    res->setup(node, values);
+
+    return res;
+  }
+
+  void
+  Pipeline::run(const std::vector<std::string> &files, BufferPool &pool)
+  {
+    // The window of batches in flight keeps the workers busy, while the pool is the reader's credit. The reader holds
+    // on to the previous chunk (for the carry over) while it acquires the next one, hence the minimum of two chunks.
+    size_t window = 1;
+
+    Expects(pool.num_chunks() >= 2);
+    if (workers_.size() > 1) {
+      window = workers_.size() * 2;
+      for (auto &worker : workers_) {
+        threads_.emplace_back(&Pipeline::work_loop, this, std::ref(worker));
+      }
+    }
+    reorder_ = std::make_unique<ReorderBuffer>(*sink_, window);
+    if (stats_ || max_memory_ > 0) {
+      memory_ = std::make_unique<Memory>(pool, max_memory_);
+      reorder_->set_budget(max_memory_ / OUTPUT_SHARE);
+    }
+    if (stats_) {
+      reorder_->set_latency(&stats_->latency());
+      reorder_->set_held(&memory_->output());
+      stats_->set_memory(memory_.get());
+      stats_->start();
+    }
+
+    try {
+      if (files.empty()) {
+        process(STDIN_FILENO, pool);
+      } else {
+        for (auto const &file : files) {
+          int fd = open(file.c_str(), O_RDONLY);
+
+          if (fd < 0) {
+            throw std::system_error(errno, std::system_category(), "can not open " + file);
+          }
+
+          auto closer = gsl::finally([fd] { close(fd); });
+
+          process(fd, pool);
+        }
+      }
+    } catch (...) {
+      stop();
+      throw;
+    }
+    stop();
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+
+    // All batches are written, so the outputs can flush whatever they held back, in the order of the threads
+    for (auto &worker : workers_) {
+      auto out = reorder_->acquire();
+
+      worker.output->attach(out.get());
+      worker.output->flush();
+      reorder_->release(sequence_++, std::move(out));
+    }
+    sink_->flush();
+  }
+
+  // Read the input one Buffer at a time, and push each batch through the pipeline. A trailing, partial, record
+  // is carried over to the beginning of the next Buffer. So is the rest of the input when the reader ends a batch
+  // early, which can happen at the end of the input too.
+  void
+  Pipeline::process(int fd, BufferPool &pool)
+  {
+    std::shared_ptr<Buffer> prev;
+    size_t carry = 0;
+    bool eof     = false;
+
+    while (!eof || carry > 0) {
+      auto start = StageStats::Clock::now();
+
+      // Don't get ahead of the output by more than the window, or by more held output than the budget
+      if (!reorder_->wait(sequence_)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        std::rethrow_exception(error_);
+      }
+
+      // Over the memory limit, let everything in flight drain before reading more
+      if (memory_ && memory_->over()) {
+        if (askr::debug::Do<askr::debug::MEMORY>()) {
+          std::cerr << "Pipeline: " << memory_->used() << " bytes in use, over the limit of " << memory_->limit()
+                    << ", draining" << std::endl;
+        }
+        if (!reorder_->drain(sequence_)) {
+          std::lock_guard<std::mutex> lock(mutex_);
+
+          std::rethrow_exception(error_);
+        }
+      }
+
+      // Wait for a chunk, which the batches in flight release as they are rendered
+      std::shared_ptr<Buffer> buffer = pool.acquire(true);
+
+      // The reader's scratch space can never take the room of the carry over
+      buffer->reserve(std::min(reader_->reserve(buffer->capacity()), buffer->capacity() - carry));
+
+      if (reader_stats_) {
+        reader_stats_->wait(start);
+        start = StageStats::Clock::now();
+      }
+      if (carry > 0) {
+        memcpy(buffer->data(), prev->data() + prev->size() - carry, carry);
+      }
+      prev.reset();
+
+      size_t size = carry;
+
+      while (!eof && size < buffer->capacity()) {
+        ssize_t n = read(fd, buffer->data() + size, buffer->capacity() - size);
+
+        if (n < 0) {
+          if (errno == EINTR) {
+            continue;
+          }
+          throw std::system_error(errno, std::system_category(), "read() failed");
+        } else if (n == 0) {
+          eof = true;
+          break;
+        }
+        size += n;
+      }
+      buffer->set_size(size);
+
+      auto read       = stats_ ? StageStats::Clock::now() : StageStats::Clock::time_point{};
+      int64_t heap    = stats_ ? Memory::thread_heap() : 0;
+      auto batch      = std::make_unique<RecordBatch>(buffer, projection_, reader_.get());
+      size_t consumed = reader_->parse(*batch, eof);
+
+      if (!eof && consumed == 0) {
+        throw std::runtime_error("a record is larger than the buffer chunk size");
+      }
+      if (reader_stats_) {
+        heap = Memory::thread_heap() - heap;
+        reader_stats_->add(batch->size(), batch->size(), consumed, start);
+        reader_stats_->heap(heap);
+        memory_->batches().add(size);
+      }
+      dispatch(std::move(batch), read, heap);
+
+      // At the end of the input, a reader which consumes nothing has nothing left to give
+      carry = (eof && consumed == 0) ? 0 : size - consumed;
+      prev  = std::move(buffer);
+    }
+  }
+
+  // Give the batch its sequence number, and hand it to a worker thread. With one thread, this does the work.
+  void
+  Pipeline::dispatch(std::unique_ptr<RecordBatch> batch, StageStats::Clock::time_point read, int64_t heap)
+  {
+    batch->set_sequence(sequence_++);
+    if (threads_.empty()) {
+      work(workers_[0], {std::move(batch), read, {}, heap});
+    } else {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        queue_.push_back({std::move(batch), read, stats_ ? StageStats::Clock::now() : StageStats::Clock::time_point{}, heap});
+      }
+      cond_.notify_one();
+    }
+  }
+
+  // Filter and render one batch. The batch (and its Buffer chunk) is released before the output is, such that
+  // the chunk is back in the pool by the time the reader is let through the window.
+  void
+  Pipeline::work(Worker &worker, Queued item)
+  {
+    auto &batch       = item.batch;
+    uint64_t sequence = batch->sequence();
+    auto out          = reorder_->acquire();
+
+    if (!stats_) {
+      for (auto const &filter : worker.filters) {
+        filter->process(*batch);
+      }
+      worker.output->attach(out.get());
+      worker.output->output(*batch);
+      batch.reset();
+
+      reorder_->release(sequence, std::move(out));
+      return;
+    }
+
+    // The same, with the --stats accounting
+    size_t bytes = batch->buffer()->size();
+
+    if (item.queued != StageStats::Clock::time_point{}) {
+      (worker.filters.empty() ? worker.output_stats : worker.filter_stats[0])->wait(item.queued);
+    }
+    for (size_t ix = 0; ix < worker.filters.size(); ++ix) {
+      auto start   = StageStats::Clock::now();
+      int64_t heap = Memory::thread_heap();
+      size_t in    = batch->selection().size();
+
+      worker.filters[ix]->process(*batch);
+      worker.filter_stats[ix]->add(in, batch->selection().size(), bytes, start);
+      worker.filter_heaps[ix] = Memory::thread_heap() - heap;
+      worker.filter_stats[ix]->heap(worker.filter_heaps[ix]);
+    }
+
+    auto start   = StageStats::Clock::now();
+    int64_t heap = Memory::thread_heap();
+
+    worker.output->attach(out.get());
+    worker.output->output(*batch);
+    worker.output_stats->add(batch->selection().size(), batch->selection().size(), out->size(), start);
+    worker.output_stats->heap(Memory::thread_heap() - heap);
+
+    // What the batch frees is what the reader, and then the filters, allocated into it. Credit that back in
+    // pipeline order, such that what a plugin allocated and kept for itself stays accounted to it.
+    heap = Memory::thread_heap();
+    batch.reset();
+
+    int64_t freed  = heap - Memory::thread_heap();
+    int64_t credit = std::max<int64_t>(std::min(item.heap, freed), 0);
+
+    reader_stats_->heap(-credit);
+    freed -= credit;
+    for (size_t ix = 0; ix < worker.filters.size() && freed > 0; ++ix) {
+      credit = std::min(std::max<int64_t>(worker.filter_heaps[ix], 0), freed);
+      worker.filter_stats[ix]->heap(-credit);
+      freed -= credit;
+    }
+    memory_->batches().add(-static_cast<int64_t>(bytes));
+
+    start = StageStats::Clock::now();
+    reorder_->release(sequence, std::move(out), item.read);
+    worker.output_stats->wait(start);
+  }
+
+  void
+  Pipeline::work_loop(Worker &worker)
+  {
+    try {
+      while (true) {
+        Queued queued;
+
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+
+          cond_.wait(lock, [this] { return !queue_.empty() || finished_; });
+          if (queue_.empty() || error_) {
+            break;
+          }
+          queued = std::move(queue_.front());
+          queue_.pop_front();
+        }
+        work(worker, std::move(queued));
+      }
+    } catch (...) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (!error_) {
+          error_ = std::current_exception();
+        }
+        finished_ = true;
+        queue_.clear(); // Release their chunks, the reader could be waiting for one
+      }
+      cond_.notify_all();
+      reorder_->abort();
+    }
+  }
+
+  // Let the worker threads finish the queued batches, and wait for them.
+  void
+  Pipeline::stop()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      finished_ = true;
+    }
+    cond_.notify_all();
+    for (auto &thread : threads_) {
+      thread.join();
+    }
+    threads_.clear();
+  }
+
+} // namespace askr
@@ -0,0 +1,146 @@
+/**
+ * @file
+ * @brief Include file for the processing pipeline, input -> filter(s) -> output
+ *
+ * The pipeline loads all the plugins named in the script, and drives the data through them. This is not a
+ * public API.
+ *
+ * The reader runs on the main thread. With more than one thread, the batches are filtered and rendered by a
+ * set of worker threads, each with its own instances of the filters and the output plugin, and the rendered
+ * output is written in input order through the ReorderBuffer.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <yaml-cpp/yaml.h>
+
+#include "askr/buffers.h"
+#include "askr/plugin.h"
+#include "askr/sink.h"
+#include "reorder.h"
+#include "stats.h"
+
+namespace askr
+{
+/**
+ * @class Pipeline
+ * @brief The loaded plugins of a script, and the driver which pushes the input through them.
+ */
+class Pipeline
+{
+public:
+    Pipeline() = delete;
+    Pipeline(const Pipeline &) = delete;
+    Pipeline &operator=(const Pipeline &) = delete;
+
+    /**
+     * @brief Construct a new Pipeline object, loading and setting up all the plugins of the script.
+     *
+     * This also collects the keys that the filter and output plugins request, into the projection the
+     * reader uses. Any configuration problems are thrown, as YAML::ParserException's where possible.
+     *
+     * @param config    The entire YAML script
+     * @param values    The values of all the script specific command line options
+     * @param threads   The number of threads filtering and rendering the batches
+     */
+    Pipeline(const YAML::Node &config, const OptionValues &values, size_t threads = 1);
+
+    /**
+     * @brief Destroy the Pipeline object, and unload all the plugins.
+     */
+    ~Pipeline();
+
+    /**
+     * @brief Process all the inputs, through the reader, all the filters and the output.
+     *
+     * @param files    The input files, standard input is used if this is empty
+     * @param pool     The pool of Buffer chunks to read into, at least two chunks are required
+     */
+    void run(const std::vector<std::string> &files, BufferPool &pool);
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The keys that the reader materializes
+     */
+    const Projection &
+    projection() const
+    {
+        return projection_;
+    }
+
+private:
+    /**
+     * @brief The plugin instances of one thread.
+     */
+    struct Worker {
+        std::vector<std::unique_ptr<Filter>> filters;
+        std::unique_ptr<Output> output;
+        std::vector<StageStats *> filter_stats; /**< The --stats counters of the filters, if enabled */
+        StageStats *output_stats = nullptr;
+        std::vector<int64_t> filter_heaps;      /**< The heap each filter allocated for the current batch */
+    };
+
+    /**
+     * @brief A batch on its way to a worker, when it was read and queued, and the heap the reader allocated for it.
+     *        These are only set with --stats.
+     */
+    struct Queued {
+        std::unique_ptr<RecordBatch> batch;
+        StageStats::Clock::time_point read;
+        StageStats::Clock::time_point queued;
+        int64_t heap = 0;
+    };
+
+    static constexpr size_t OUTPUT_SHARE = 4; /**< Held output is budgeted a quarter of --max-memory */
+
+    template <class T> std::unique_ptr<T> load(const YAML::Node &node, const OptionValues &values);
+
+    void process(int fd, BufferPool &pool);
+    void dispatch(std::unique_ptr<RecordBatch> batch, StageStats::Clock::time_point read, int64_t heap);
+    void work(Worker &worker, Queued item);
+    void work_loop(Worker &worker);
+    void stop();
+
+    std::vector<void *> handles_; /**< The dlopen() handles, these are closed after all plugins are destroyed */
+    std::unique_ptr<Memory> memory_; /**< The memory accounting, with --stats or --max-memory */
+    std::unique_ptr<Stats> stats_; /**< The --stats counters, if enabled. This reports once all plugins are done */
+    std::unique_ptr<Sink> sink_;  /**< Standard output */
+    std::unique_ptr<ReorderBuffer> reorder_;
+    std::unique_ptr<Reader> reader_;
+    StageStats *reader_stats_ = nullptr;
+    std::vector<Worker> workers_;
+    Projection projection_;
+    uint64_t sequence_ = 0; /**< The sequence number of the next batch */
+    size_t max_memory_ = 0; /**< The --max-memory limit, 0 if none */
+
+    // The queue of batches for the worker threads, only used with more than one thread
+    std::vector<std::thread> threads_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::deque<Queued> queue_;
+    bool finished_ = false;
+    std::exception_ptr error_;
+};
+} // namespace askr
@@ -0,0 +1,100 @@
+/**
+ * @file
+ * @brief Implementation details for the plugin base classes
+ *
+ * These are out of line on purpose, such that the vtables and type information of the plugin interfaces live in
+ * the askr binary, and are shared by all the dynamically loaded plugins.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <map>
+
+#include "askr/plugin.h"
+
+namespace
+{
+  // The plugins linked into the binary, registered during static initialization
+  std::map<std::string, askr::PluginFactory> &
+  static_plugins()
+  {
+    static std::map<std::string, askr::PluginFactory> plugins;
+
+    return plugins;
+  }
+} // namespace
+
+namespace askr
+{
+  bool
+  register_static_plugin(const char *file, PluginFactory factory)
+  {
+    std::string name(file);
+    size_t slash = name.rfind('/');
+    size_t dot   = name.rfind('.');
+
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+      name.erase(dot);
+    }
+    if (slash != std::string::npos) {
+      name.erase(0, slash + 1);
+    }
+    static_plugins()[name + ".so"] = factory;
+
+    return true;
+  }
+
+  PluginFactory
+  find_static_plugin(const std::string &name)
+  {
+    auto it = static_plugins().find(name);
+
+    return it == static_plugins().end() ? nullptr : it->second;
+  }
+
+  Plugin::~Plugin() {}
+
+  void
+  Plugin::setup(const YAML::Node &, const OptionValues &)
+  {
+  }
+
+  void
+  Plugin::columns(Projection &) const
+  {
+  }
+
+  Reader::~Reader() {}
+
+  size_t
+  Reader::reserve(size_t) const
+  {
+    return 0;
+  }
+
+  bool
+  Reader::is_json(std::string_view, std::string_view) const
+  {
+    return false;
+  }
+
+  Filter::~Filter() {}
+
+  Output::~Output() {}
+
+  void
+  Output::flush()
+  {
+  }
+
+} // namespace askr
@@ -0,0 +1,125 @@
+/**
+ * @file
+ * @brief Implementation details for the reorder buffer
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include "reorder.h"
+#include "gsl/gsl"
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class ReorderBuffer
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  ReorderBuffer::ReorderBuffer(Sink &sink, size_t window) : sink_(sink), window_(window)
+  {
+    Expects(window_ > 0);
+  }
+
+  bool
+  ReorderBuffer::wait(uint64_t sequence)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    cond_.wait(lock, [&] { return aborted_ || (sequence < next_ + window_ && (budget_ == 0 || held_size_ <= budget_)); });
+
+    return !aborted_;
+  }
+
+  bool
+  ReorderBuffer::drain(uint64_t sequence)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    cond_.wait(lock, [&] { return aborted_ || sequence <= next_; });
+
+    return !aborted_;
+  }
+
+  std::unique_ptr<OutputBuffer>
+  ReorderBuffer::acquire()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (free_.empty()) {
+      return std::make_unique<OutputBuffer>();
+    }
+
+    auto out = std::move(free_.back());
+
+    free_.pop_back();
+
+    return out;
+  }
+
+  // Hold the buffer, and if it's the next in sequence (and nobody else is writing), write out everything that
+  // is now in order. The Sink is written without holding the lock, so other threads can keep releasing.
+  void
+  ReorderBuffer::release(uint64_t sequence, std::unique_ptr<OutputBuffer> out, std::chrono::steady_clock::time_point read)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    Expects(sequence >= next_);
+    held_size_ += out->size();
+    if (held_bytes_) {
+      held_bytes_->add(out->size());
+    }
+    held_.emplace(sequence, std::make_pair(std::move(out), read));
+    if (writing_) {
+      return;
+    }
+
+    writing_ = true;
+    while (!held_.empty() && held_.begin()->first == next_) {
+      auto ready = std::move(held_.begin()->second.first);
+      auto read  = held_.begin()->second.second;
+
+      held_.erase(held_.begin());
+      lock.unlock();
+      try {
+        sink_.append(ready->data(), ready->size());
+      } catch (...) {
+        lock.lock();
+        writing_ = false;
+        throw;
+      }
+      if (latency_ && read != std::chrono::steady_clock::time_point{}) {
+        latency_->record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - read).count());
+      }
+      if (held_bytes_) {
+        held_bytes_->add(-static_cast<int64_t>(ready->size()));
+      }
+      lock.lock();
+      held_size_ -= ready->size();
+      ready->clear();
+      free_.emplace_back(std::move(ready));
+      ++next_;
+      cond_.notify_all();
+    }
+    writing_ = false;
+  }
+
+  void
+  ReorderBuffer::abort()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      aborted_ = true;
+    }
+    cond_.notify_all();
+  }
+
+} // namespace askr
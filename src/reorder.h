@@ -0,0 +1,164 @@
+/**
+ * @file
+ * @brief Include file for the reorder buffer, which writes the rendered output of batches in input order
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "askr/sink.h"
+#include "histogram.h"
+#include "memory.h"
+
+namespace askr
+{
+/**
+ * @class ReorderBuffer
+ * @brief The sequenced stage in front of the Sink, releasing the rendered batches in input order.
+ *
+ * Each batch is rendered, on any thread, into its own OutputBuffer, which is then released with the sequence
+ * number of the batch. Buffers which are released out of order are held until all earlier sequences have been
+ * released. Only the thread releasing the next expected sequence writes to the Sink, and it writes any held
+ * buffers that are then in order too; all other threads just drop off their buffer and continue.
+ *
+ * The window bounds the number of sequences in flight. An optional budget also bounds the bytes of rendered output
+ * that are held, such that a slow consumer holds back the reader before the held output piles up, even when the
+ * batches render to much more than they read.
+ */
+class ReorderBuffer
+{
+public:
+    ReorderBuffer() = delete;
+    ReorderBuffer(const ReorderBuffer &) = delete;
+    ReorderBuffer &operator=(const ReorderBuffer &) = delete;
+
+    /**
+     * @brief Construct a new ReorderBuffer object.
+     *
+     * @param sink     The Sink to write the buffers to, in order
+     * @param window   The maximum number of sequences in flight, at least 1
+     */
+    ReorderBuffer(Sink &sink, size_t window);
+
+    /**
+     * @brief Wait until a sequence number fits in the window, that is, until enough earlier sequences are written,
+     *        and until the held output is within the budget.
+     *
+     * @param sequence   The sequence number about to be dispatched
+     * @return           False if the reorder buffer was aborted while waiting
+     */
+    bool wait(uint64_t sequence);
+
+    /**
+     * @brief Get an empty OutputBuffer to render a batch into. Buffers are recycled once written.
+     *
+     * @return  The OutputBuffer
+     */
+    std::unique_ptr<OutputBuffer> acquire();
+
+    /**
+     * @brief Release the rendered output of a sequence, writing it (and any following sequences) when in order.
+     *
+     * @param sequence   The sequence number of the rendered batch
+     * @param out        The rendered output, which can be empty
+     * @param read       When the input of the batch was read, for the latency histogram
+     */
+    void release(uint64_t sequence, std::unique_ptr<OutputBuffer> out, std::chrono::steady_clock::time_point read = {});
+
+    /**
+     * @brief Record the latency of every batch, from when its input was read until its output is written. Only
+     *        one thread writes at a time, so this is a single writer histogram.
+     *
+     * @param latency   The histogram, in nanoseconds
+     */
+    void
+    set_latency(Histogram *latency)
+    {
+        latency_ = latency;
+    }
+
+    /**
+     * @brief Account for the rendered output that is held, waiting for earlier sequences to be released.
+     *
+     * @param held   The gauge, in bytes
+     */
+    void
+    set_held(Gauge *held)
+    {
+        held_bytes_ = held;
+    }
+
+    /**
+     * @brief Bound the rendered output that is held, waiting for earlier sequences or for the Sink. This must be set
+     *        before any sequence is released, if at all.
+     *
+     * @param budget   The bytes of held output above which wait() holds back, 0 for no budget
+     */
+    void
+    set_budget(size_t budget)
+    {
+        budget_ = budget;
+    }
+
+    /**
+     * @brief Wait until all sequences before a sequence number are written, that is, until nothing is in flight.
+     *
+     * @param sequence   The sequence number about to be dispatched
+     * @return           False if the reorder buffer was aborted while waiting
+     */
+    bool drain(uint64_t sequence);
+
+    /**
+     * @brief Stop all waiting, typically because a thread failed.
+     */
+    void abort();
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The next sequence number to be written
+     */
+    uint64_t
+    next() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        return next_;
+    }
+
+private:
+    Sink &sink_;
+    size_t window_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cond_;
+    uint64_t next_ = 0;     /**< The next sequence to write */
+    bool writing_  = false; /**< A thread is currently writing to the Sink */
+    bool aborted_  = false;
+    size_t held_size_ = 0;  /**< The bytes of held output, until it is written to the Sink */
+    size_t budget_    = 0;  /**< The held output above which wait() holds back, 0 if none */
+    std::map<uint64_t, std::pair<std::unique_ptr<OutputBuffer>, std::chrono::steady_clock::time_point>> held_;
+    std::vector<std::unique_ptr<OutputBuffer>> free_;
+    Histogram *latency_ = nullptr;
+    Gauge *held_bytes_  = nullptr;
+};
+} // namespace askr
@@ -0,0 +1,251 @@
+/**
+ * @file
+ * @brief Implementation details for the output sink
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <algorithm>
+#include <iostream>
+#include <cerrno>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "askr/askr.h"
+#include "askr/sink.h"
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class OutputBuffer
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  void
+  OutputBuffer::grow(size_t needed)
+  {
+    size_t capacity = std::max(needed, std::max(capacity_ * 2, INITIAL_SIZE));
+    std::unique_ptr<char[]> data(new char[capacity]);
+
+    if (size_ > 0) {
+      memcpy(data.get(), data_.get(), size_);
+    }
+    data_     = std::move(data);
+    capacity_ = capacity;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class Sink
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  Sink::Sink(int fd, size_t block_size) : fd_(fd), size_(block_size)
+  {
+    struct stat st;
+
+    size_ = std::max(MIN_BLOCK_SIZE, std::min(MAX_BLOCK_SIZE, size_));
+
+#if defined(F_SETPIPE_SZ) && defined(F_GETPIPE_SZ)
+    // For pipes, make the pipe hold exactly one block. This is limited by /proc/sys/fs/pipe-max-size, so we
+    // shrink the blocks down to what the pipe can hold. If not even the smallest block fits, we don't splice.
+    if (fstat(fd_, &st) == 0 && S_ISFIFO(st.st_mode)) {
+      for (size_t size = size_; size >= MIN_BLOCK_SIZE; size /= 2) {
+        if (fcntl(fd_, F_SETPIPE_SZ, static_cast<int>(size)) >= 0) {
+          int pipe_size = fcntl(fd_, F_GETPIPE_SZ);
+
+          if (pipe_size > 0 && static_cast<size_t>(pipe_size) == size) {
+            size_   = size;
+            splice_ = true;
+          }
+          break;
+        }
+      }
+    }
+#endif
+
+    for (size_t ix = 0; ix < NUM_BLOCKS; ++ix) {
+      remap(ix);
+    }
+    current_ = blocks_[0];
+
+    if (askr::debug::Do<askr::debug::BASIC>()) {
+      std::cerr << "Sink: using blocks of " << size_ << " bytes" << (splice_ ? ", with vmsplice()" : "") << std::endl;
+    }
+
+    thread_ = std::thread(&Sink::writer, this);
+  }
+
+  Sink::~Sink()
+  {
+    try {
+      flush();
+    } catch (std::exception &e) {
+      std::cerr << "error writing output: " << e.what() << std::endl;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+
+      done_ = true;
+    }
+    cond_.notify_all();
+    thread_.join();
+
+    for (auto block : blocks_) {
+      munmap(block, size_);
+    }
+  }
+
+  // The blocks are mapped, rather than allocated, such that spliced pages are never reused by the allocator. The
+  // pipe holds its own references to spliced pages, so unmapping a block which is still in the pipe is fine.
+  void
+  Sink::remap(size_t ix)
+  {
+    if (blocks_[ix]) {
+      munmap(blocks_[ix], size_);
+      blocks_[ix] = nullptr;
+    }
+
+    void *addr = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (addr == MAP_FAILED) {
+      throw std::system_error(errno, std::system_category(), "mmap() of the output blocks failed");
+    }
+    blocks_[ix]   = static_cast<char *>(addr);
+    released_[ix] = 0;
+  }
+
+  void
+  Sink::flush()
+  {
+    if (used_ > 0) {
+      submit();
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    wait_idle(lock);
+  }
+
+  // Fill up the current block, and continue in the next block(s).
+  void
+  Sink::append_slow(const char *data, size_t len)
+  {
+    while (len > 0) {
+      size_t n = std::min(len, size_ - used_);
+
+      memcpy(current_ + used_, data, n);
+      used_ += n;
+      data += n;
+      len -= n;
+      if (used_ == size_) {
+        submit();
+      }
+    }
+  }
+
+  // Hand the current block to the writer thread, once it's done with the previous block, and move on to the next
+  // block. With full blocks, that block was spliced two blocks ago, so the pipe no longer refers to it.
+  void
+  Sink::submit()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    wait_idle(lock);
+    pending_     = current_;
+    pending_ix_  = block_;
+    pending_len_ = used_;
+    block_       = (block_ + 1) % NUM_BLOCKS;
+    if (written_ < released_[block_]) {
+      remap(block_);
+    }
+    current_ = blocks_[block_];
+    used_    = 0;
+    lock.unlock();
+    cond_.notify_all();
+  }
+
+  void
+  Sink::wait_idle(std::unique_lock<std::mutex> &lock)
+  {
+    cond_.wait(lock, [this] { return pending_ == nullptr; });
+    if (error_) {
+      std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+  }
+
+  void
+  Sink::writer()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (true) {
+      cond_.wait(lock, [this] { return pending_ != nullptr || done_; });
+      if (!pending_) {
+        break;
+      }
+
+      const char *data = pending_;
+      size_t len       = pending_len_;
+      bool spliced     = splice_;
+
+      lock.unlock();
+      try {
+        write_block(data, len);
+      } catch (...) {
+        lock.lock();
+        error_ = std::current_exception();
+        lock.unlock();
+      }
+      lock.lock();
+      written_ += len;
+      if (spliced) {
+        released_[pending_ix_] = written_ + size_;
+      }
+      pending_ = nullptr;
+      cond_.notify_all();
+    }
+  }
+
+  void
+  Sink::write_block(const char *data, size_t len)
+  {
+    while (len > 0) {
+      ssize_t n;
+
+      if (splice_) {
+        struct iovec iov = {const_cast<char *>(data), len};
+
+        n = vmsplice(fd_, &iov, 1, 0);
+        if (n < 0 && errno != EINTR && errno != EAGAIN) {
+          // Not spliceable after all, e.g. the pipe was replaced, fall back to regular writes
+          splice_ = false;
+          continue;
+        }
+      } else {
+        n = write(fd_, data, len);
+      }
+      if (n < 0) {
+        if (errno == EINTR || errno == EAGAIN) {
+          continue;
+        }
+        throw std::system_error(errno, std::system_category(), "write() failed");
+      }
+      data += n;
+      len -= n;
+    }
+  }
+
+} // namespace askr
@@ -0,0 +1,157 @@
+/**
+ * @file
+ * @brief Implementation details for the pipeline statistics
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <cstdio>
+#include <iostream>
+#include <map>
+
+#include "stats.h"
+
+namespace
+{
+  // The percentiles of a histogram of nanoseconds, in microseconds
+  std::string
+  percentiles(const askr::Histogram &histogram)
+  {
+    char buf[256];
+
+    snprintf(buf, sizeof(buf), "\"count\":%llu,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f",
+             static_cast<unsigned long long>(histogram.count()), histogram.percentile(50) / 1e3,
+             histogram.percentile(90) / 1e3, histogram.percentile(99) / 1e3, histogram.percentile(99.9) / 1e3,
+             histogram.max() / 1e3);
+
+    return buf;
+  }
+} // namespace
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class StageStats
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  std::string
+  StageStats::json(const char *kind, double elapsed) const
+  {
+    uint64_t records_in  = records_in_.load(std::memory_order_relaxed);
+    uint64_t records_out = records_out_.load(std::memory_order_relaxed);
+    char thread[16], heap[64], buf[640];
+
+    if (thread_ == NO_THREAD) {
+      snprintf(thread, sizeof(thread), "null");
+    } else {
+      snprintf(thread, sizeof(thread), "%d", thread_);
+    }
+    if (Memory::heap_available()) {
+      snprintf(heap, sizeof(heap), "%lld,\"heap_peak\":%lld", static_cast<long long>(heap_.current()),
+               static_cast<long long>(heap_.peak()));
+    } else {
+      snprintf(heap, sizeof(heap), "null,\"heap_peak\":null");
+    }
+    snprintf(buf, sizeof(buf),
+             "{\"stats\":\"%s\",\"elapsed\":%.3f,\"stage\":\"%s\",\"index\":%zu,\"plugin\":\"%s\",\"thread\":%s,"
+             "\"batches\":%llu,\"records_in\":%llu,\"records_out\":%llu,\"bytes\":%llu,\"seconds\":%.6f,"
+             "\"wait_seconds\":%.6f,\"selectivity\":%.4f,\"heap_bytes\":%s}",
+             kind, elapsed, stage_.c_str(), index_, plugin_.c_str(), thread,
+             static_cast<unsigned long long>(batches_.load(std::memory_order_relaxed)),
+             static_cast<unsigned long long>(records_in), static_cast<unsigned long long>(records_out),
+             static_cast<unsigned long long>(bytes_.load(std::memory_order_relaxed)),
+             nanoseconds_.load(std::memory_order_relaxed) / 1e9, wait_nanoseconds_.load(std::memory_order_relaxed) / 1e9,
+             records_in > 0 ? static_cast<double>(records_out) / records_in : 1.0, heap);
+
+    return buf;
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class Stats
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  Stats::Stats(unsigned interval) : interval_(interval) {}
+
+  Stats::~Stats()
+  {
+    if (thread_.joinable()) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        done_ = true;
+      }
+      cond_.notify_all();
+      thread_.join();
+    }
+    report("final");
+  }
+
+  StageStats &
+  Stats::add(const std::string &stage, const std::string &plugin, size_t index, int thread)
+  {
+    stages_.emplace_back(std::make_unique<StageStats>(stage, plugin, index, thread));
+
+    return *stages_.back();
+  }
+
+  void
+  Stats::start()
+  {
+    start_ = StageStats::Clock::now();
+    if (interval_ > 0) {
+      thread_ = std::thread(&Stats::reporter, this);
+    }
+  }
+
+  // One line per instance, then one per stage, the latency and the memory, written in one go such that the reports
+  // don't interleave with other diagnostics
+  void
+  Stats::report(const char *kind) const
+  {
+    double elapsed = std::chrono::duration<double>(StageStats::Clock::now() - start_).count();
+    std::map<size_t, std::pair<const StageStats *, Histogram>> merged;
+    std::string out;
+    char prefix[128];
+
+    for (auto const &stage : stages_) {
+      out += stage->json(kind, elapsed);
+      out += '\n';
+
+      auto &[first, histogram] = merged[stage->index()];
+
+      first = first ? first : stage.get();
+      histogram.merge(stage->histogram());
+    }
+    for (auto const &[index, histogram] : merged) {
+      snprintf(prefix, sizeof(prefix), "{\"stats\":\"%s\",\"elapsed\":%.3f,\"histogram\":\"%s\",\"index\":%zu,\"plugin\":\"%s\",",
+               kind, elapsed, histogram.first->stage().c_str(), index, histogram.first->plugin().c_str());
+      out += prefix + percentiles(histogram.second) + "}\n";
+    }
+    snprintf(prefix, sizeof(prefix),
+             "{\"stats\":\"%s\",\"elapsed\":%.3f,\"histogram\":\"latency\",\"index\":null,\"plugin\":null,", kind, elapsed);
+    out += prefix + percentiles(latency_) + "}\n";
+    if (memory_) {
+      out += memory_->json(kind, elapsed) + "\n";
+    }
+    std::cerr << out << std::flush;
+  }
+
+  void
+  Stats::reporter()
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    while (!cond_.wait_for(lock, std::chrono::seconds(interval_), [this] { return done_; })) {
+      report("interval");
+    }
+  }
+
+} // namespace askr
@@ -0,0 +1,273 @@
+/**
+ * @file
+ * @brief Include file for the pipeline statistics, which the --stats option reports
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "histogram.h"
+#include "memory.h"
+
+namespace askr
+{
+/**
+ * @class StageStats
+ * @brief The counters of one plugin instance, that is one stage of the pipeline on one thread.
+ *
+ * Only the thread running the instance updates its counters, so there is no contention. They are relaxed atomics
+ * such that the periodic reports can read them while the pipeline runs.
+ */
+class StageStats
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr int NO_THREAD = -1; /**< The thread of the reader, which runs on the main thread */
+
+    StageStats(std::string stage, std::string plugin, size_t index, int thread)
+        : stage_(std::move(stage)), plugin_(std::move(plugin)), index_(index), thread_(thread)
+    {
+    }
+
+    /**
+     * @brief Account for one batch processed by the instance.
+     *
+     * @param records_in    The selected records going into the instance
+     * @param records_out   The selected records coming out of it
+     * @param bytes         The bytes processed, read or rendered
+     * @param start         When the instance started on the batch, it ended now
+     */
+    void
+    add(uint64_t records_in, uint64_t records_out, uint64_t bytes, Clock::time_point start)
+    {
+        uint64_t nanoseconds = since(start);
+
+        batches_.fetch_add(1, std::memory_order_relaxed);
+        records_in_.fetch_add(records_in, std::memory_order_relaxed);
+        records_out_.fetch_add(records_out, std::memory_order_relaxed);
+        bytes_.fetch_add(bytes, std::memory_order_relaxed);
+        nanoseconds_.fetch_add(nanoseconds, std::memory_order_relaxed);
+        histogram_.record(nanoseconds);
+    }
+
+    /**
+     * @brief Account for time the instance waited, rather than processed. For the reader, this is the time it was
+     *        held back by the window of batches in flight. For the first plugin of a worker thread, it is the time
+     *        its batches sat in the queue. For the output, it also includes handing the rendered batches to
+     *        standard output, which is where a slow consumer shows up.
+     *
+     * @param start         When the wait started, it ended now
+     */
+    void
+    wait(Clock::time_point start)
+    {
+        wait_nanoseconds_.fetch_add(since(start), std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Account for heap memory the instance allocated and kept, or released with a negative delta. This can
+     *        be called from any thread, e.g. when a batch allocated by the reader is destroyed by a worker.
+     *
+     * @param delta   The change in bytes, see Memory::thread_heap()
+     */
+    void
+    heap(int64_t delta)
+    {
+        heap_.add(delta);
+    }
+
+    /**
+     * @brief Render the counters as a JSON object, on one line.
+     *
+     * @param kind      What triggered the report, "interval" or "final"
+     * @param elapsed   The seconds since the pipeline started
+     * @return          The JSON object
+     */
+    std::string json(const char *kind, double elapsed) const;
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The histogram of the per batch processing times, in nanoseconds
+     */
+    const Histogram &
+    histogram() const
+    {
+        return histogram_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The stage, "reader", "filter" or "output"
+     */
+    const std::string &
+    stage() const
+    {
+        return stage_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The position of the stage in the pipeline
+     */
+    size_t
+    index() const
+    {
+        return index_;
+    }
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The plugin name
+     */
+    const std::string &
+    plugin() const
+    {
+        return plugin_;
+    }
+
+private:
+    static uint64_t
+    since(Clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+    }
+
+    std::string stage_;  /**< "reader", "filter" or "output" */
+    std::string plugin_; /**< The plugin name, e.g. "selector.so" */
+    size_t index_;       /**< The position of the stage in the pipeline, the reader being 0 */
+    int thread_;         /**< The worker thread, or NO_THREAD */
+
+    std::atomic<uint64_t> batches_          = 0;
+    std::atomic<uint64_t> records_in_       = 0;
+    std::atomic<uint64_t> records_out_      = 0;
+    std::atomic<uint64_t> bytes_            = 0;
+    std::atomic<uint64_t> nanoseconds_      = 0;
+    std::atomic<uint64_t> wait_nanoseconds_ = 0;
+    Histogram histogram_;
+    Gauge heap_;
+};
+
+/**
+ * @class Stats
+ * @brief All the StageStats of a pipeline, and the reporting of them to standard error.
+ *
+ * Each report is one JSON object per plugin instance, e.g.
+ *
+ *     {"stats":"final","elapsed":2.104,"stage":"filter","index":1,"plugin":"expression","thread":0,"batches":52,
+ *      "records_in":1048576,"records_out":10342,"bytes":218103808,"seconds":0.213,"wait_seconds":0.002,
+ *      "selectivity":0.0099,"heap_bytes":4096,"heap_peak":8192}
+ *
+ * followed by the percentiles of the per batch processing times of each stage, merged over its threads, and of
+ * the latency of the batches, from when their input was read until their output was handed to standard output:
+ *
+ *     {"stats":"final","elapsed":2.104,"histogram":"filter","index":1,"plugin":"expression","count":52,
+ *      "p50_us":3968,"p90_us":4352,"p99_us":5120,"p999_us":5120,"max_us":5203}
+ *     {"stats":"final","elapsed":2.104,"histogram":"latency","index":null,"plugin":null,"count":52,...}
+ *
+ * and last the memory accounting of the pipeline, see Memory:
+ *
+ *     {"stats":"final","elapsed":2.104,"memory":"pipeline","limit":null,"heap":9437184,"pool":67108864,
+ *      "pool_in_use":4194304,"pool_peak":16777216,"batches":0,"batches_peak":8388608,"output":0,
+ *      "output_peak":524288,"throttled":0}
+ *
+ * The final report is made when the Stats is destroyed, and with an interval there is a report every so often
+ * while the pipeline runs.
+ */
+class Stats
+{
+public:
+    Stats(const Stats &) = delete;
+    Stats &operator=(const Stats &) = delete;
+
+    /**
+     * @brief Construct a new Stats object.
+     *
+     * @param interval   The seconds between the periodic reports, or 0 for only the final report
+     */
+    explicit Stats(unsigned interval);
+
+    /**
+     * @brief Destroy the Stats object, after making the final report.
+     */
+    ~Stats();
+
+    /**
+     * @brief Add the counters of a plugin instance. The returned reference remains valid for the life of the Stats.
+     *
+     * @param stage     "reader", "filter" or "output"
+     * @param plugin    The plugin name
+     * @param index     The position of the stage in the pipeline
+     * @param thread    The worker thread, or StageStats::NO_THREAD
+     * @return          The counters of the instance
+     */
+    StageStats &add(const std::string &stage, const std::string &plugin, size_t index, int thread);
+
+    /**
+     * @brief Start the periodic reports, if an interval was given. The instances must all be added before this.
+     */
+    void start();
+
+    /**
+     * @brief Simple getter.
+     *
+     * @return  The histogram of the end-to-end latency of the batches, in nanoseconds
+     */
+    Histogram &
+    latency()
+    {
+        return latency_;
+    }
+
+    /**
+     * @brief Include the memory accounting in the reports. This must be set before start(), if at all.
+     *
+     * @param memory   The memory accounting, which must outlive the Stats
+     */
+    void
+    set_memory(const Memory *memory)
+    {
+        memory_ = memory;
+    }
+
+private:
+    void report(const char *kind) const;
+    void reporter();
+
+    std::vector<std::unique_ptr<StageStats>> stages_;
+    Histogram latency_;
+    const Memory *memory_ = nullptr;
+    StageStats::Clock::time_point start_ = StageStats::Clock::now();
+    unsigned interval_;
+
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool done_ = false;
+};
+} // namespace askr
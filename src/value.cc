@@ -0,0 +1,207 @@
+/**
+ * @file
+ * @brief Implementation details for the typed (decoded) values
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <cctype>
+#include <charconv>
+#include <cstring>
+
+#include "askr/value.h"
+
+namespace
+{
+  // Parse exactly n digits, returns -1 if any of them is not a digit.
+  inline int
+  digits(const char *p, int n)
+  {
+    int res = 0;
+
+    for (int i = 0; i < n; ++i) {
+      unsigned d = static_cast<unsigned char>(p[i]) - '0';
+
+      if (d > 9) {
+        return -1;
+      }
+      res = res * 10 + d;
+    }
+
+    return res;
+  }
+
+  // Days since 1970-01-01 of a proleptic Gregorian date (Howard Hinnant's days_from_civil()).
+  inline int64_t
+  days_from_civil(int64_t y, unsigned m, unsigned d)
+  {
+    y -= m <= 2;
+
+    const int64_t era  = (y >= 0 ? y : y - 399) / 400;
+    const unsigned yoe = static_cast<unsigned>(y - era * 400);
+    const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+    return era * 146097 + static_cast<int64_t>(doe) - 719468;
+  }
+
+  // Parse an ISO 8601 / RFC 3339 time stamp: YYYY-MM-DD[T ]hh:mm:ss[.ffffff][Z|(+|-)hh:mm]
+  bool
+  parse_timestamp(std::string_view str, int64_t &usec)
+  {
+    const char *p   = str.data();
+    const char *end = p + str.size();
+
+    if (str.size() < 19 || p[4] != '-' || p[7] != '-' || (p[10] != 'T' && p[10] != ' ') || p[13] != ':' || p[16] != ':') {
+      return false;
+    }
+
+    int year = digits(p, 4), month = digits(p + 5, 2), day = digits(p + 8, 2);
+    int hour = digits(p + 11, 2), min = digits(p + 14, 2), sec = digits(p + 17, 2);
+
+    if (year < 0 || month < 1 || month > 12 || day < 1 || day > 31 || hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 ||
+        sec > 60) {
+      return false;
+    }
+
+    int64_t frac = 0;
+
+    p += 19;
+    if (p < end && (*p == '.' || *p == ',')) {
+      int64_t scale = 100000;
+
+      for (++p; p < end && *p >= '0' && *p <= '9'; ++p) {
+        frac += (*p - '0') * scale;
+        scale /= 10;
+      }
+    }
+
+    int64_t offset = 0;
+
+    if (p < end) {
+      if (*p == 'Z' || *p == 'z') {
+        ++p;
+      } else if ((*p == '+' || *p == '-') && end - p >= 6 && p[3] == ':') {
+        int oh = digits(p + 1, 2), om = digits(p + 4, 2);
+
+        if (oh < 0 || om < 0) {
+          return false;
+        }
+        offset = (*p == '+' ? 1 : -1) * (oh * 3600 + om * 60);
+        p += 6;
+      }
+    }
+    if (p != end) {
+      return false;
+    }
+
+    int64_t secs = days_from_civil(year, month, day) * 86400 + hour * 3600 + min * 60 + sec - offset;
+
+    usec = secs * 1000000 + frac;
+    return true;
+  }
+
+  // Parse a Common Log Format time stamp: DD/Mon/YYYY:hh:mm:ss (+|-)hhmm
+  bool
+  parse_clf_timestamp(std::string_view str, int64_t &usec)
+  {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    const char *p              = str.data();
+
+    if (str.size() != 26 || p[2] != '/' || p[6] != '/' || p[11] != ':' || p[14] != ':' || p[17] != ':' || p[20] != ' ' ||
+        (p[21] != '+' && p[21] != '-')) {
+      return false;
+    }
+
+    int month = 0;
+
+    while (month < 12 && memcmp(months + month * 3, p + 3, 3) != 0) {
+      ++month;
+    }
+
+    int day = digits(p, 2), year = digits(p + 7, 4);
+    int hour = digits(p + 12, 2), min = digits(p + 15, 2), sec = digits(p + 18, 2);
+    int oh = digits(p + 22, 2), om = digits(p + 24, 2);
+
+    if (month == 12 || day < 1 || day > 31 || year < 0 || hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 60 ||
+        oh < 0 || om < 0) {
+      return false;
+    }
+
+    int64_t offset = (p[21] == '+' ? 1 : -1) * (oh * 3600 + om * 60);
+    int64_t secs   = days_from_civil(year, month + 1, day) * 86400 + hour * 3600 + min * 60 + sec - offset;
+
+    usec = secs * 1000000;
+    return true;
+  }
+} // namespace
+
+namespace askr
+{
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+  // Implementation details for class TypedValue
+  ////////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // Try the integer first, it is the most common, and the cheapest. Where the integer parse stops tells us
+  // which of the other types is worth trying.
+  TypedValue
+  TypedValue::parse(std::string_view str)
+  {
+    TypedValue res;
+
+    if (!str.data()) {
+      res.type_ = NONE;
+      return res;
+    }
+    res.type_ = STRING;
+    if (str.empty()) {
+      return res;
+    }
+
+    const char *end = str.data() + str.size();
+    int64_t integer;
+    auto [ptr, ec] = std::from_chars(str.data(), end, integer);
+
+    if (ec == std::errc() && ptr == end) {
+      return TypedValue::integer(integer);
+    }
+    if (ptr == str.data() + 4 && *ptr == '-') {
+      if (int64_t usec; parse_timestamp(str, usec)) {
+        return TypedValue::timestamp(usec);
+      }
+      return res;
+    }
+    if (ptr == str.data() + 2 && *ptr == '/') {
+      if (int64_t usec; parse_clf_timestamp(str, usec)) {
+        return TypedValue::timestamp(usec);
+      }
+      return res;
+    }
+
+    // std::from_chars() also takes "nan", "inf" and "infinity", which are left as strings
+    const char *lead = str.data() + (str[0] == '-');
+
+    if (lead == end || !(std::isdigit(static_cast<unsigned char>(*lead)) || *lead == '.')) {
+      return res;
+    }
+
+    double number;
+
+    if (auto [fptr, fec] = std::from_chars(str.data(), end, number); fec == std::errc() && fptr == end) {
+      return TypedValue::floating(number);
+    }
+
+    return res;
+  }
+
+} // namespace askr
@@ -0,0 +1,360 @@
+/**
+ * @file
+ * @brief askr-bench, the micro-benchmarks of the readers, filters and outputs (make bench)
+ *
+ * Every benchmark runs over the same synthetic corpus, tab separated key=value lines of a given width and number
+ * of fields, and reports one JSON object per line, e.g.
+ *
+ *     {"benchmark":"csv_reader.parse","width":200,"fields":10,"records":335544,"bytes":67108864,"seconds":0.081,...}
+ *
+ * Only the component itself is timed. E.g. for the filters and outputs, the batches are parsed up front.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <bitset>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+#include <getopt.h>
+
+#include "askr/buffers.h"
+#include "askr/plugin.h"
+#include "expression.h"
+
+namespace askr
+{
+  namespace debug
+  {
+    std::bitset<16> gLevel;
+  } // namespace debug
+} // namespace askr
+
+namespace
+{
+  size_t gSink = 0; // Keeps the compiler from optimizing away results that are otherwise unused
+
+  struct Settings {
+    size_t width     = 200; /**< Approximate width of each line */
+    size_t fields    = 10;  /**< Number of key=value fields per line, at least 2 */
+    size_t megabytes = 64;  /**< Size of the corpus */
+    size_t repeat    = 3;   /**< Runs per benchmark, the fastest is reported */
+    std::string only;       /**< Only run the benchmarks with this prefix */
+    bool jit = false;       /**< Also benchmark the JIT compiled expressions */
+  };
+
+  /**
+   * @brief The corpus, in Buffers of whole lines. Field k0 is a status code, k1 a word, and the rest are filler.
+   */
+  class Corpus
+  {
+  public:
+    Corpus(const Settings &settings)
+      : pool_(askr::BufferPool::DEFAULT_CHUNK_SIZE, settings.megabytes * 1024 * 1024 / askr::BufferPool::DEFAULT_CHUNK_SIZE + 1)
+    {
+      static const char *statuses[] = {"200", "200", "200", "200", "200", "200", "304", "404", "500", "503"};
+      static const char *words[]    = {"GET", "GET", "GET", "POST", "HEAD", "PUT"};
+      static const char alnum[]     = "abcdefghijklmnopqrstuvwxyz0123456789";
+      std::mt19937_64 rng(1);
+      size_t filler = 1;
+      std::string line;
+
+      if (settings.fields > 2 && settings.width > 12 + 8 * settings.fields) {
+        filler = (settings.width - 12) / (settings.fields - 2) - 6;
+      }
+
+      while (bytes_ < settings.megabytes * 1024 * 1024) {
+        auto buffer = pool_.acquire();
+        char *data  = buffer->data();
+        size_t size = 0;
+
+        while (true) {
+          line = "k0=";
+          line += statuses[rng() % 10];
+          line += "\tk1=";
+          line += words[rng() % 6];
+          for (size_t field = 2; field < settings.fields; ++field) {
+            line += "\tk" + std::to_string(field) + "=";
+            for (size_t ix = 0; ix < filler; ++ix) {
+              line += alnum[rng() % 36];
+            }
+          }
+          while (settings.fields > 2 && line.size() + 1 < settings.width) {
+            line += alnum[rng() % 36]; // Pad the last field to the line width
+          }
+          line += '\n';
+          if (size + line.size() > buffer->capacity() || bytes_ + size >= settings.megabytes * 1024 * 1024) {
+            break;
+          }
+          memcpy(data + size, line.data(), line.size());
+          size += line.size();
+        }
+        buffer->set_size(size);
+        bytes_ += size;
+        buffers_.push_back(std::move(buffer));
+      }
+    }
+
+    const std::vector<std::shared_ptr<askr::Buffer>> &
+    buffers() const
+    {
+      return buffers_;
+    }
+
+    size_t
+    bytes() const
+    {
+      return bytes_;
+    }
+
+  private:
+    askr::BufferPool pool_;
+    std::vector<std::shared_ptr<askr::Buffer>> buffers_;
+    size_t bytes_ = 0;
+  };
+
+  // Load a plugin, linked in or from ASKR_PLUGIN_DIR, and set it up from a YAML snippet
+  template <class T>
+  std::unique_ptr<T>
+  load(const std::string &name, const std::string &yaml, const askr::OptionValues &values = {})
+  {
+    askr::PluginFactory factory = askr::find_static_plugin(name);
+
+    if (!factory) {
+      const char *dir  = getenv("ASKR_PLUGIN_DIR");
+      std::string path = std::string(dir && *dir ? dir : ".") + "/" + name;
+      void *handle     = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL); // Never closed, the process is short lived
+
+      if (!handle || !(factory = reinterpret_cast<askr::PluginFactory>(dlsym(handle, "askr_plugin_create")))) {
+        throw std::runtime_error("can not load " + path + ": " + dlerror());
+      }
+    }
+
+    std::unique_ptr<T> plugin(dynamic_cast<T *>(factory()));
+
+    plugin->setup(YAML::Load(yaml), values);
+
+    return plugin;
+  }
+
+  /**
+   * @brief Runs and reports the benchmarks.
+   */
+  class Bench
+  {
+  public:
+    Bench(const Settings &settings, const Corpus &corpus) : settings_(settings), corpus_(corpus) {}
+
+    // Time a benchmark, where prepare() sets up each Buffer outside of the timing, and run() is timed
+    void
+    run(const std::string &name, const std::function<void(size_t)> &prepare, const std::function<size_t(size_t)> &run)
+    {
+      if (name.compare(0, settings_.only.size(), settings_.only) != 0) {
+        return;
+      }
+
+      double best    = 0;
+      size_t records = 0;
+
+      for (size_t rep = 0; rep < settings_.repeat; ++rep) {
+        std::chrono::duration<double> elapsed(0);
+
+        records = 0;
+        for (size_t ix = 0; ix < corpus_.buffers().size(); ++ix) {
+          prepare(ix);
+
+          auto start = std::chrono::steady_clock::now();
+
+          records += run(ix);
+          elapsed += std::chrono::steady_clock::now() - start;
+        }
+        best = (rep == 0 || elapsed.count() < best) ? elapsed.count() : best;
+      }
+
+      printf("{\"benchmark\":\"%s\",\"width\":%zu,\"fields\":%zu,\"records\":%zu,\"bytes\":%zu,\"seconds\":%.6f,"
+             "\"records_per_sec\":%.0f,\"bytes_per_sec\":%.0f}\n",
+             name.c_str(), settings_.width, settings_.fields, records, corpus_.bytes(), best, records / best,
+             corpus_.bytes() / best);
+      fflush(stdout);
+    }
+
+  private:
+    const Settings &settings_;
+    const Corpus &corpus_;
+  };
+
+  void
+  usage()
+  {
+    std::cerr << "usage: askr-bench [-w width] [-f fields] [-m megabytes] [-r repeat] [-b benchmark prefix] [-J]" << std::endl;
+  }
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+  Settings settings;
+  int c;
+
+  while ((c = getopt(argc, argv, "w:f:m:r:b:Jh")) != -1) {
+    switch (c) {
+    case 'w':
+      settings.width = strtoul(optarg, nullptr, 10);
+      break;
+    case 'f':
+      settings.fields = std::max(2ul, strtoul(optarg, nullptr, 10));
+      break;
+    case 'm':
+      settings.megabytes = std::max(1ul, strtoul(optarg, nullptr, 10));
+      break;
+    case 'r':
+      settings.repeat = std::max(1ul, strtoul(optarg, nullptr, 10));
+      break;
+    case 'b':
+      settings.only = optarg;
+      break;
+    case 'J':
+      settings.jit = true;
+      break;
+    default:
+      usage();
+      return c == 'h' ? 0 : 1;
+    }
+  }
+
+  try {
+    Corpus corpus(settings);
+    Bench bench(settings, corpus);
+    std::vector<std::unique_ptr<askr::RecordBatch>> batches(corpus.buffers().size());
+    askr::OptionValues values;
+    askr::Projection none, projected, wide;
+    std::string last = "k" + std::to_string(settings.fields - 1);
+    std::string pattern = "k0=%{int:k0}\tk1=%{word:k1}";
+
+    projected.add("k0");
+    projected.add("k1");
+    for (size_t field = 0; field < settings.fields; ++field) {
+      wide.add("k" + std::to_string(field));
+    }
+    for (size_t field = 2; field < settings.fields; ++field) {
+      pattern += "\tk" + std::to_string(field) + "=%{notspace:k" + std::to_string(field) + "}";
+    }
+
+    auto csv     = load<askr::Reader>("csv_reader.so", "configs: {col-separator: [\"\\t\"], keyval-separator: [\"=\"]}");
+    auto matcher = load<askr::Reader>("pattern_reader.so", "configs: {pattern: \"" + pattern + "\"}");
+    auto text    = load<askr::Output>("text.so", "configs: {format: \"$(key)=$(value)\"}");
+    auto json    = load<askr::Output>("json.so", "{}");
+
+    auto parse = [&](askr::Reader &reader, const askr::Projection &projection) {
+      return [&](size_t ix) {
+        batches[ix] = std::make_unique<askr::RecordBatch>(corpus.buffers()[ix], projection, &reader);
+        reader.parse(*batches[ix], true);
+      };
+    };
+    auto nothing = [](size_t) {};
+
+    // Readers
+    bench.run("csv_reader.parse", nothing, [&](size_t ix) {
+      askr::RecordBatch batch(corpus.buffers()[ix], projected, csv.get());
+
+      csv->parse(batch, true);
+      return batch.size();
+    });
+    bench.run("csv_reader.parse.wide", nothing, [&](size_t ix) {
+      askr::RecordBatch batch(corpus.buffers()[ix], wide, csv.get());
+
+      csv->parse(batch, true);
+      return batch.size();
+    });
+    bench.run("pattern_reader.parse", nothing, [&](size_t ix) {
+      askr::RecordBatch batch(corpus.buffers()[ix], projected, matcher.get());
+
+      matcher->parse(batch, true);
+      return batch.size();
+    });
+
+    // The lazy KeyValueStore of the records
+    bench.run("keyvalue.fields", parse(*csv, none), [&](size_t ix) {
+      size_t fields = 0;
+
+      for (size_t row = 0; row < batches[ix]->size(); ++row) {
+        fields += batches[ix]->store(row).fields().size();
+      }
+      gSink += fields;
+      return batches[ix]->size();
+    });
+    bench.run("keyvalue.find", parse(*csv, none), [&](size_t ix) {
+      size_t found = 0;
+
+      for (size_t row = 0; row < batches[ix]->size(); ++row) {
+        found += batches[ix]->store(row).find(last).data() != nullptr;
+      }
+      return found;
+    });
+
+    // Filters
+    values.add("expression", "k0>=400");
+    values.add("expression", "k1!=HEAD");
+
+    auto expression = std::make_unique<askr::Expression>();
+
+    expression->setup({}, values);
+    bench.run("expression", parse(*csv, projected), [&](size_t ix) {
+      size_t records = batches[ix]->size();
+
+      expression->process(*batches[ix]);
+      return records;
+    });
+    if (settings.jit) {
+      values.add("jit", "true");
+
+      auto jit = std::make_unique<askr::Expression>();
+
+      jit->setup({}, values);
+      bench.run("expression.jit", parse(*csv, projected), [&](size_t ix) {
+        size_t records = batches[ix]->size();
+
+        jit->process(*batches[ix]);
+        return records;
+      });
+    }
+
+    // Outputs, each rendering every field of the records
+    askr::OutputBuffer out;
+
+    text->attach(&out);
+    bench.run("text.output", parse(*csv, none), [&](size_t ix) {
+      out.clear();
+      text->output(*batches[ix]);
+      return batches[ix]->size();
+    });
+    json->attach(&out);
+    bench.run("json.output", parse(*csv, none), [&](size_t ix) {
+      out.clear();
+      json->output(*batches[ix]);
+      return batches[ix]->size();
+    });
+  } catch (std::exception &e) {
+    std::cerr << "askr-bench: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
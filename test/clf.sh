@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# make check: the Common, Combined and W3C extended log formats
+#
+#  Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+#  file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+#  file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+#  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+#  specific language governing permissions and limitations under the License.
+#
+
+. "${srcdir:-.}/common.sh"
+
+check clf-common.out clf-common
+check clf-common-filter.out clf-common -s client,url,status -e 'status>=400'
+check clf-combined.out clf-combined
+check clf-combined-filter.out clf-combined -s method,url,agent -e 'agent=curl/8.4.0'
+
+# The quoted fields are compared, and presented, with their escapes decoded
+check clf-combined-escapes.out clf-combined -s request,url,referer,agent -e 'agent=Foo "bar" baz \ A'
+
+# A #Fields directive changes the fields of the lines after it
+check clf-w3c.out clf-w3c
+check clf-w3c-filter.out clf-w3c -s c-ip,sc-status -e 'sc-status>=404'
+
+exit $failed
@@ -0,0 +1,68 @@
+#
+# make check: the helpers of the fixture driven tests, sourced by each of them
+#
+#  Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+#  file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+#  file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+#  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+#  specific language governing permissions and limitations under the License.
+#
+# ASKR and ASKR_PLUGIN_DIR come from the Makefile, so the tests run the uninstalled binary and plugins.
+
+fixtures="${srcdir:-.}/fixtures"
+actual="$(mktemp)"
+failed=0
+
+trap 'rm -f "$actual"' EXIT
+
+# The -e checks also run with -J, if the JIT has a compiler to work with
+jit=yes
+if ! "$ASKR" "$fixtures/filter.yaml" -J -e 'k>0' "$fixtures/filter.log" > /dev/null 2>&1; then
+  echo "SKIP: -J, the JIT can not compile"
+  jit=no
+fi
+
+# run <expected> <name> [options...]
+#
+# Run the script fixtures/<name>.yaml with the options over its input, and compare the output to fixtures/<expected>.
+run()
+{
+  expected="$1"
+  name="$2"
+  shift 2
+
+  if ! "$ASKR" "$fixtures/$name.yaml" "$@" "$fixtures/${input:-$name}.log" > "$actual"; then
+    echo "FAIL: $name $*: askr failed"
+    failed=1
+  elif ! diff -u "$fixtures/$expected" "$actual"; then
+    echo "FAIL: $name $*: output differs from $expected"
+    failed=1
+  fi
+}
+
+# check <expected> <name> [options...]
+#
+# Run the script fixtures/<name>.yaml with the options over fixtures/<name>.log, with one thread and with several,
+# and compare the output to fixtures/<expected>. Set input to read fixtures/<input>.log instead. With -e options,
+# the JIT must select the same records as the interpreter.
+check()
+{
+  expected="$1"
+  name="$2"
+  shift 2
+
+  run "$expected" "$name" -t 1 "$@"
+  run "$expected" "$name" -t 3 "$@"
+
+  for arg in "$@"; do
+    if [ "$arg" = "-e" ] && [ "$jit" = yes ]; then
+      run "$expected" "$name" -t 3 -J "$@"
+      break
+    fi
+  done
+}
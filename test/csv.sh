@@ -0,0 +1,25 @@
+#!/bin/sh
+#
+# make check: csv_reader.so, where the columns and the lazily tokenized fields must agree
+#
+#  Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+#  file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+#  file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+#  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+#  specific language governing permissions and limitations under the License.
+#
+
+. "${srcdir:-.}/common.sh"
+
+# Without -s every field is tokenized lazily, with it the keys are columns. A duplicate key has its first value
+check csv.out csv
+check csv-select.out csv -s a,b,c
+check csv-first.out csv -s a,c -e 'a=1'
+check csv-dup.out csv -s a -e 'a>=2' -e 'a<=4'
+
+exit $failed
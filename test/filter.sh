@@ -0,0 +1,26 @@
+#!/bin/sh
+#
+# make check: the -e filter, with numeric, string and missing values
+#
+#  Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+#  file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+#  file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+#  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+#  specific language governing permissions and limitations under the License.
+#
+
+. "${srcdir:-.}/common.sh"
+
+# nan and inf are strings, not numbers that compare equal to everything
+check filter-nan.out filter -s id -e 'k=nan'
+check filter-inf.out filter -s id -e 'k=inf'
+check filter-gt.out filter -s id -e 'k>0'
+check filter-lt.out filter -s id -e 'k<1'
+check filter-ne.out filter -s id -e 'k!=1.5'
+
+exit $failed
@@ -0,0 +1,31 @@
+#!/bin/sh
+#
+# make check: JSON lines read with json_reader.so and written back with json.so
+#
+#  Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+#  file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+#  file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+#  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+#  specific language governing permissions and limitations under the License.
+#
+
+. "${srcdir:-.}/common.sh"
+
+# The escapes are decoded when read, and encoded again when written
+check json.out json
+check json-filter.out json -s id,msg,request.url -e 'status>=400'
+check json-escapes.out json -s id,msg -e 'msg=say "hi"'
+check json-nested.out json -s id,request.url -e 'request.url=/a"b'
+
+# Strings that look like numbers or literals stay strings
+check json-types.out json -s zip,flag,v,n,e,raw -e 'id=5'
+
+# A duplicate key has its first value, in the columns the same as in the lazy lookups
+check json-dup.out json -s id,dup -e 'dup=first'
+
+exit $failed
@@ -0,0 +1,28 @@
+#!/bin/sh
+#
+# make check: RFC 5424 messages with structured data, and RFC 3164 messages
+#
+#  Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+#  file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+#  file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+#  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+#  specific language governing permissions and limitations under the License.
+#
+
+. "${srcdir:-.}/common.sh"
+
+check syslog.out syslog
+check syslog-filter.out syslog -s host,app,exampleSDID@32473.eventSource,examplePriority@32473.path -e 'pri>=100'
+
+# The structured data values are compared after decoding their escapes
+check syslog-escapes.out syslog -s app,exampleSDID@32473.eventSource -e 'exampleSDID@32473.eventSource=Appl "ic" \ation'
+
+# A repeated parameter has its first value, in the columns the same as in the lazy lookups
+check syslog-repeated.out syslog -s msgid,origin.ip -e 'origin.ip=192.0.2.1'
+
+exit $failed
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# make check: the formats of text.so, with and without selector.so
+#
+#  Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+#  file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+#  file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+#  with the License.  You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+#  Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+#  an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+#  specific language governing permissions and limitations under the License.
+#
+
+. "${srcdir:-.}/common.sh"
+
+input=text
+
+# $(key) and $(value) render once per field, in the order of the record or of -s
+check text-fields.out text-fields
+check text-fields-select.out text-fields -s url,client,missing
+check text-fields-filter.out text-fields -s client -e 'status>=400'
+check text-values.out text-values
+check text-values-select.out text-values -s status,url
+
+# Named fields render once per record, a missing one is empty, and -s does not change them
+check text-named.out text-named
+check text-named-select.out text-named -s client -e 'status>=500'
+check text-literal.out text-literal -e 'status>=400'
+
+exit $failed
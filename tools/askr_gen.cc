@@ -0,0 +1,490 @@
+/**
+ * @file
+ * @brief askr-gen, a generator of synthetic log corpora, for training (PGO) and benchmarking askr
+ *
+ * The corpora are deterministic for a given seed, and come in the formats of the bundled readers:
+ *
+ *     kv       Tab separated key=value pairs (csv_reader.so)
+ *     clf      The Combined Log Format (clf_reader.so, pattern_reader.so)
+ *     json     JSON Lines (json_reader.so)
+ *     syslog   RFC 5424, with structured data (syslog_reader.so)
+ *
+ * The corpus is generated in blocks of BLOCK_LINES lines, each with its own generator seeded from the seed and
+ * the block number. The worker threads generate the blocks in any order, and the main thread writes them in order,
+ * so the output does not depend on the number of threads. E.g. a 50GB corpus, gzip'ed by a parallel compressor:
+ *
+ *     askr-gen -f clf -b 50G -u 1000000 -z 1.1 -d 30 -C zstd > clf.log.zst
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+namespace
+{
+  const char *METHODS[] = {"GET", "GET", "GET", "GET", "GET", "GET", "POST", "POST", "HEAD", "PUT", "DELETE"};
+  const int SUCCESSES[] = {200, 200, 200, 200, 200, 200, 200, 200, 200, 200, 200, 200, 304, 304, 301};
+  const int ERRORS[]    = {404, 404, 404, 404, 403, 401, 400, 500, 502, 503};
+  const char *AGENTS[]  = {"Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/115.0",
+                           "Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko)",
+                           "curl/8.1.2", "Googlebot/2.1 (+http://www.google.com/bot.html)", "-"};
+  const char *APPS[]    = {"sshd", "kernel", "cron", "nginx", "postfix", "systemd"};
+
+  constexpr uint64_t BLOCK_LINES = 64 * 1024; // Lines per block, and per seed
+  constexpr time_t START         = 1577836800; // 2020-01-01T00:00:00Z
+  constexpr time_t MAX_STEP      = 2;          // The most seconds between two lines
+
+  template <class T, size_t N>
+  constexpr size_t
+  countof(T (&)[N])
+  {
+    return N;
+  }
+
+  struct Settings {
+    std::string format  = "kv";
+    uint64_t lines      = 100000; /**< Number of lines, unless bytes is set */
+    uint64_t bytes      = 0;      /**< Size of the corpus, the last line is the one that reaches it */
+    uint64_t seed       = 1;
+    uint64_t clients    = 65536;  /**< Cardinality of the client addresses */
+    uint64_t urls       = 100000; /**< Cardinality of the URLs */
+    double zipf         = 1.0;    /**< Exponent of the URL popularity, 0 is uniform */
+    double errors       = 0.1;    /**< Share of 4xx / 5xx status codes */
+    unsigned disorder   = 0;      /**< Maximum number of seconds a timestamp is behind the clock */
+    unsigned threads    = std::max(1u, std::thread::hardware_concurrency());
+    std::string compress;         /**< Compressor to pipe the output through, if any */
+  };
+
+  /**
+   * @brief A Zipf distribution over 1 .. n, using rejection-inversion (Hörmann and Derflinger, 1996). This takes
+   * constant time and memory, which matters for the large cardinalities.
+   */
+  class Zipf
+  {
+  public:
+    Zipf(uint64_t n, double exponent) : n_(static_cast<double>(n)), exponent_(exponent)
+    {
+      h_x1_ = integral(1.5) - 1.0;
+      h_n_  = integral(n_ + 0.5);
+      s_    = 2.0 - inverse(integral(2.5) - h(2.0));
+    }
+
+    template <class RNG>
+    uint64_t
+    operator()(RNG &rng) const
+    {
+      std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+      if (exponent_ <= 0.0) {
+        return 1 + static_cast<uint64_t>(uniform(rng) * n_);
+      }
+
+      while (true) {
+        double u = h_n_ + uniform(rng) * (h_x1_ - h_n_);
+        double x = inverse(u);
+        double k = std::clamp(std::floor(x + 0.5), 1.0, n_);
+
+        if (k - x <= s_ || u >= integral(k + 0.5) - h(k)) {
+          return static_cast<uint64_t>(k);
+        }
+      }
+    }
+
+  private:
+    double
+    h(double x) const
+    {
+      return std::exp(-exponent_ * std::log(x));
+    }
+
+    double
+    integral(double x) const
+    {
+      double log_x = std::log(x);
+
+      return helper2((1.0 - exponent_) * log_x) * log_x;
+    }
+
+    double
+    inverse(double x) const
+    {
+      double t = std::max(-1.0, x * (1.0 - exponent_));
+
+      return std::exp(helper1(t) * x);
+    }
+
+    // log1p(x) / x and expm1(x) / x, which are well defined around 0
+    static double
+    helper1(double x)
+    {
+      return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+    }
+
+    static double
+    helper2(double x)
+    {
+      return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+    }
+
+    double n_;
+    double exponent_;
+    double h_x1_, h_n_, s_;
+  };
+
+  /**
+   * @brief Generates the lines of one block of a corpus. All values are drawn from the generator seeded for it.
+   */
+  class Generator
+  {
+  public:
+    Generator(const Settings &settings, const Zipf &zipf, uint64_t block)
+      : settings_(settings), zipf_(zipf), time_(START + block * BLOCK_LINES * MAX_STEP)
+    {
+      std::seed_seq seq{settings.seed, block};
+
+      rng_.seed(seq);
+    }
+
+    static bool
+    valid(const std::string &format)
+    {
+      return format == "kv" || format == "clf" || format == "json" || format == "syslog";
+    }
+
+    // Append the next line, including its newline
+    void
+    line(std::string &out)
+    {
+      char client[32], when[64], url[64];
+      const char *method = METHODS[pick(countof(METHODS))];
+      int status         = status_code();
+      uint64_t bytes     = status == 304 ? 0 : 200 + pick(50000);
+      uint64_t id        = pick(settings_.clients);
+      uint64_t rank      = zipf_(rng_);
+      time_t stamp;
+      struct tm tm;
+
+      // A block never gets past the start of the next one, so without disorder the time stamps never go back
+      time_ += pick(MAX_STEP + 1);
+      stamp = settings_.disorder ? time_ - pick(settings_.disorder + 1) : time_;
+      gmtime_r(&stamp, &tm);
+      snprintf(client, sizeof(client), "10.%u.%u.%u", static_cast<unsigned>((id >> 16) & 255),
+               static_cast<unsigned>((id >> 8) & 255), static_cast<unsigned>(id & 255));
+      snprintf(url, sizeof(url), "/app/%u/item?id=%llu", static_cast<unsigned>(rank % 100),
+               static_cast<unsigned long long>(rank));
+
+      if (settings_.format == "kv") {
+        strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        append(out, "time=%s\tclient=%s\tmethod=%s\turl=%s\tstatus=%d\tbytes=%llu\tduration=%.3f\tagent=%s\n", when, client,
+               method, url, status, static_cast<unsigned long long>(bytes), pick(5000) / 1000.0, AGENTS[pick(countof(AGENTS))]);
+      } else if (settings_.format == "clf") {
+        strftime(when, sizeof(when), "%d/%b/%Y:%H:%M:%S +0000", &tm);
+        append(out, "%s - - [%s] \"%s %s HTTP/1.1\" %d %llu \"-\" \"%s\"\n", client, when, method, url, status,
+               static_cast<unsigned long long>(bytes), AGENTS[pick(countof(AGENTS))]);
+      } else if (settings_.format == "json") {
+        strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        append(out,
+               "{\"time\":\"%s\",\"client\":\"%s\",\"request\":{\"method\":\"%s\",\"url\":\"%s\"},\"status\":%d,"
+               "\"bytes\":%llu}\n",
+               when, client, method, url, status, static_cast<unsigned long long>(bytes));
+      } else {
+        strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", &tm);
+        append(out, "<%u>1 %s host%u %s %u - [req@32473 client=\"%s\" status=\"%d\"] %s %s took %ums\n", 8 + pick(184), when,
+               pick(20), APPS[pick(countof(APPS))], 1000 + pick(30000), client, status, method, url, pick(2000));
+      }
+    }
+
+  private:
+    unsigned
+    pick(uint64_t n)
+    {
+      return static_cast<unsigned>(rng_() % n);
+    }
+
+    // Mostly 200s, with the 4xx / 5xx share from the settings, and skewed towards 404s
+    int
+    status_code()
+    {
+      std::uniform_real_distribution<double> uniform(0.0, 1.0);
+
+      return uniform(rng_) < settings_.errors ? ERRORS[pick(countof(ERRORS))] : SUCCESSES[pick(countof(SUCCESSES))];
+    }
+
+    template <class... Args>
+    static void
+    append(std::string &out, const char *fmt, Args... args)
+    {
+      char buf[512];
+      int len = snprintf(buf, sizeof(buf), fmt, args...);
+
+      out.append(buf, std::min<size_t>(len, sizeof(buf) - 1));
+    }
+
+    const Settings &settings_;
+    const Zipf &zipf_;
+    std::mt19937_64 rng_;
+    time_t time_;
+  };
+
+  /**
+   * @brief Runs the worker threads, and hands the generated blocks to the writer in order. At most two blocks per
+   * thread are pending, which bounds the memory use.
+   */
+  class Blocks
+  {
+  public:
+    Blocks(const Settings &settings, uint64_t num_blocks)
+      : settings_(settings), zipf_(settings.urls, settings.zipf), end_(num_blocks)
+    {
+      for (unsigned ix = 0; ix < settings.threads; ++ix) {
+        threads_.emplace_back(&Blocks::worker, this);
+      }
+    }
+
+    ~Blocks()
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        done_ = true;
+      }
+      cond_.notify_all();
+      for (auto &thread : threads_) {
+        thread.join();
+      }
+    }
+
+    // The next block in order, which is empty at the end of the corpus
+    std::string
+    next()
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      std::string block;
+
+      cond_.wait(lock, [this] { return ready_.count(written_) > 0 || written_ >= end_; });
+      if (written_ < end_) {
+        block = std::move(ready_[written_]);
+        ready_.erase(written_++);
+        cond_.notify_all();
+      }
+
+      return block;
+    }
+
+  private:
+    void
+    worker()
+    {
+      while (true) {
+        uint64_t block;
+
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+
+          cond_.wait(lock, [this] { return done_ || claimed_ < written_ + 2 * settings_.threads; });
+          if (done_ || claimed_ >= end_) {
+            return;
+          }
+          block = claimed_++;
+        }
+
+        Generator gen(settings_, zipf_, block);
+        std::string out;
+        uint64_t lines = settings_.bytes ? BLOCK_LINES : std::min(BLOCK_LINES, settings_.lines - block * BLOCK_LINES);
+
+        out.reserve(lines * 256);
+        for (uint64_t n = 0; n < lines; ++n) {
+          gen.line(out);
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+
+          ready_[block] = std::move(out);
+        }
+        cond_.notify_all();
+      }
+    }
+
+    const Settings &settings_;
+    Zipf zipf_;
+    uint64_t end_;
+    uint64_t claimed_ = 0;
+    uint64_t written_ = 0;
+    bool done_        = false;
+    std::map<uint64_t, std::string> ready_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<std::thread> threads_;
+  };
+
+  // A size, with an optional K, M, G or T suffix
+  uint64_t
+  parse_size(const char *str)
+  {
+    char *end;
+    uint64_t size = strtoull(str, &end, 10);
+
+    switch (*end) {
+    case 'T':
+    case 't':
+      size *= 1024;
+      [[fallthrough]];
+    case 'G':
+    case 'g':
+      size *= 1024;
+      [[fallthrough]];
+    case 'M':
+    case 'm':
+      size *= 1024;
+      [[fallthrough]];
+    case 'K':
+    case 'k':
+      size *= 1024;
+      break;
+    default:
+      break;
+    }
+
+    return size;
+  }
+
+  // The command to pipe the output through, the parallel compressors use all cores
+  std::string
+  compressor(const std::string &name)
+  {
+    if (name == "gzip") {
+      return "pigz -c 2>/dev/null || gzip -c";
+    } else if (name == "zstd") {
+      return "zstd -q -c -T0";
+    } else if (name == "xz") {
+      return "xz -c -T0";
+    }
+
+    return "";
+  }
+
+  void
+  usage()
+  {
+    std::cerr << "usage: askr-gen [-f kv|clf|json|syslog] [-n lines | -b size[KMGT]] [-s seed] [-k clients] [-u urls]\n"
+                 "                [-z zipf exponent] [-e error share] [-d disorder seconds] [-t threads] [-C gzip|zstd|xz]"
+              << std::endl;
+  }
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+  Settings settings;
+  int c;
+
+  while ((c = getopt(argc, argv, "f:n:b:s:k:u:z:e:d:t:C:h")) != -1) {
+    switch (c) {
+    case 'f':
+      settings.format = optarg;
+      break;
+    case 'n':
+      settings.lines = strtoull(optarg, nullptr, 10);
+      break;
+    case 'b':
+      settings.bytes = parse_size(optarg);
+      break;
+    case 's':
+      settings.seed = strtoull(optarg, nullptr, 10);
+      break;
+    case 'k':
+      settings.clients = std::max(1ull, strtoull(optarg, nullptr, 10));
+      break;
+    case 'u':
+      settings.urls = std::max(1ull, strtoull(optarg, nullptr, 10));
+      break;
+    case 'z':
+      settings.zipf = strtod(optarg, nullptr);
+      break;
+    case 'e':
+      settings.errors = strtod(optarg, nullptr);
+      break;
+    case 'd':
+      settings.disorder = strtoul(optarg, nullptr, 10);
+      break;
+    case 't':
+      settings.threads = std::max(1ul, strtoul(optarg, nullptr, 10));
+      break;
+    case 'C':
+      settings.compress = optarg;
+      break;
+    default:
+      usage();
+      return c == 'h' ? 0 : 1;
+    }
+  }
+
+  if (!Generator::valid(settings.format) || (!settings.compress.empty() && compressor(settings.compress).empty())) {
+    usage();
+    return 1;
+  }
+
+  FILE *out = stdout;
+
+  if (!settings.compress.empty() && !(out = popen(compressor(settings.compress).c_str(), "w"))) {
+    std::cerr << "askr-gen: can not run " << compressor(settings.compress) << std::endl;
+    return 1;
+  }
+
+  uint64_t num_blocks = settings.bytes ? UINT64_MAX : (settings.lines + BLOCK_LINES - 1) / BLOCK_LINES;
+  uint64_t written    = 0;
+  bool ok             = true;
+
+  {
+    Blocks blocks(settings, num_blocks);
+
+    for (std::string block = blocks.next(); !block.empty(); block = blocks.next()) {
+      size_t size = block.size();
+
+      // The last block of a sized corpus ends with the line that reaches the size
+      if (settings.bytes && written + size >= settings.bytes) {
+        size = block.find('\n', settings.bytes - written - 1) + 1;
+      }
+      if (fwrite(block.data(), 1, size, out) != size) {
+        ok = false;
+        break;
+      }
+      written += size;
+      if (settings.bytes && written >= settings.bytes) {
+        break;
+      }
+    }
+  }
+
+  if (out != stdout) {
+    ok = pclose(out) == 0 && ok;
+  }
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,388 @@
+/**
+ * @file
+ * @brief askr-harness, the end-to-end throughput benchmark of askr scripts (make e2e)
+ *
+ * This runs an askr script over a corpus, once per combination of thread count (-t) and page cache state, and
+ * reports one JSON object per run, e.g.
+ *
+ *     askr-harness -t 1,2,4 -c cold,warm -- script.yaml -e status=500 corpus.log
+ *
+ *     {"script":"script.yaml","threads":2,"cache":"cold","bytes":1073741824,"seconds":1.92,"gb_per_sec":0.52,...}
+ *
+ * The arguments after -- are askr's, the first being the script. Every argument naming a regular file, other than
+ * the script, is part of the corpus. For a cold cache, the corpus is evicted from the page cache before each run,
+ * which works for any user (no drop_caches). For a warm cache, it is read once up front.
+ *
+ * The per-stage breakdown (-s) comes from askr's --stats, summing the seconds of each stage over its threads. That
+ * instruments askr, so it is taken in one extra run per combination, which is not timed.
+ *
+ * The output can be saved (-S) as the baseline for later runs (-B), in which case any run that got slower than its
+ * baseline by more than the tolerance (-T, in percent) is reported, and the exit status is 2.
+ */
+
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one or more contributor license agreements.  See the NOTICE
+ * file distributed with this work for additional information regarding copyright ownership.  The ASF licenses this
+ * file to you under the Apache License, Version 2.0 (the "License"); you may not use this file except in compliance
+ * with the License.  You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software distributed under the License is distributed on
+ * an "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations under the License.
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <getopt.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+  struct Settings {
+    std::string askr = "askr";         /**< The askr binary to run */
+    std::vector<std::string> threads;  /**< Values for askr's -t, none means askr's default */
+    std::vector<std::string> caches;   /**< "cold" and / or "warm" */
+    size_t repeat    = 3;              /**< Runs per combination, the fastest is reported */
+    std::string baseline;              /**< Compare against this baseline */
+    std::string save;                  /**< Save the results as a baseline */
+    double tolerance = 10.0;           /**< Allowed slowdown against the baseline, in percent */
+    bool stages      = false;          /**< Add the per-stage breakdown, from an extra run with --stats */
+    bool verbose     = false;          /**< Let askr's stderr through */
+  };
+
+  struct Result {
+    std::string script;
+    std::string threads;
+    std::string cache;
+    uint64_t bytes    = 0;
+    double seconds    = 0;
+    double user       = 0;
+    double sys        = 0;
+    long max_rss      = 0; // KB
+    std::map<std::string, double> stages; // "<index> <plugin>" -> seconds, from --stats
+  };
+
+  std::vector<std::string>
+  split(const std::string &str)
+  {
+    std::vector<std::string> res;
+    std::stringstream ss(str);
+    std::string item;
+
+    while (std::getline(ss, item, ',')) {
+      if (!item.empty()) {
+        res.push_back(item);
+      }
+    }
+
+    return res;
+  }
+
+  // Evict a file from the page cache, or read it all into the page cache
+  void
+  cache(const std::string &path, bool warm)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+
+    if (fd < 0) {
+      return;
+    }
+    if (warm) {
+      static char buf[1 << 20];
+
+      while (read(fd, buf, sizeof(buf)) > 0) {
+      }
+    } else {
+      posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    }
+    close(fd);
+  }
+
+  // The value of a field of a JSON line written by askr or ourselves, so no need for a real JSON parser
+  std::string
+  field(const std::string &line, const std::string &name)
+  {
+    auto pos = line.find("\"" + name + "\":");
+
+    if (pos == std::string::npos) {
+      return "";
+    }
+    pos += name.size() + 3;
+
+    if (line[pos] == '"') {
+      return line.substr(pos + 1, line.find('"', pos + 1) - pos - 1);
+    }
+
+    return line.substr(pos, line.find_first_of(",}", pos) - pos);
+  }
+
+  // Sum up the final --stats of each stage, over all of its threads
+  void
+  stages(const std::string &path, bool verbose, Result &result)
+  {
+    static const std::string STATS = "{\"stats\":", FINAL = STATS + "\"final\"";
+    std::ifstream in(path);
+
+    for (std::string line; std::getline(in, line);) {
+      if (line.compare(0, FINAL.size(), FINAL) == 0 && !field(line, "stage").empty()) {
+        result.stages[field(line, "index") + " " + field(line, "plugin")] += std::stod("0" + field(line, "seconds"));
+      } else if (verbose && line.compare(0, STATS.size(), STATS) != 0) {
+        std::cerr << line << std::endl;
+      }
+    }
+  }
+
+  // Run askr once, with its stdout to /dev/null, and measure it
+  bool
+  run(const Settings &settings, const std::vector<std::string> &args, Result &result)
+  {
+    const char *tmp = getenv("TMPDIR");
+    std::string log = std::string(tmp && *tmp ? tmp : "/tmp") + "/askr-harness.XXXXXX";
+    int fd          = mkstemp(log.data());
+    std::vector<char *> argv;
+
+    if (fd < 0) {
+      return false;
+    }
+
+    for (auto const &arg : args) {
+      argv.push_back(const_cast<char *>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid  = fork();
+
+    if (pid == 0) {
+      int null = open("/dev/null", O_WRONLY);
+
+      dup2(null, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+      execvp(argv[0], argv.data());
+      _exit(127);
+    }
+    close(fd);
+
+    int status;
+    struct rusage usage;
+    bool ok = pid > 0 && wait4(pid, &status, 0, &usage) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+
+    stages(log, settings.verbose, result);
+    unlink(log.c_str());
+    if (!ok) {
+      return false;
+    }
+
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.user    = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6;
+    result.sys     = usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+    result.max_rss = usage.ru_maxrss;
+
+    return true;
+  }
+
+  std::string
+  json(const Result &res)
+  {
+    char buf[1024];
+
+    snprintf(buf, sizeof(buf),
+             "{\"script\":\"%s\",\"threads\":%s,\"cache\":\"%s\",\"bytes\":%llu,\"seconds\":%.3f,\"gb_per_sec\":%.3f,"
+             "\"max_rss_kb\":%ld,\"user\":%.3f,\"sys\":%.3f,\"cpu\":%.2f}",
+             res.script.c_str(), res.threads.empty() ? "null" : res.threads.c_str(), res.cache.c_str(),
+             static_cast<unsigned long long>(res.bytes), res.seconds, res.bytes / res.seconds / 1e9, res.max_rss, res.user,
+             res.sys, (res.user + res.sys) / res.seconds);
+
+    std::string line = buf;
+
+    if (!res.stages.empty()) {
+      const char *sep = "";
+
+      line.pop_back();
+      line += ",\"stages\":{";
+      for (auto const &[stage, seconds] : res.stages) {
+        snprintf(buf, sizeof(buf), "%s\"%s\":%.3f", sep, stage.c_str(), seconds);
+        line += buf;
+        sep = ",";
+      }
+      line += "}}";
+    }
+
+    return line;
+  }
+
+  std::string
+  key(const std::string &script, const std::string &threads, const std::string &cache)
+  {
+    return script + "/" + (threads.empty() ? "null" : threads) + "/" + cache;
+  }
+
+  void
+  usage()
+  {
+    std::cerr << "usage: askr-harness [-a askr] [-t threads,...] [-c cold,warm] [-r repeat] [-B baseline] [-S baseline]\n"
+                 "                    [-T tolerance %] [-s] [-v] -- script.yaml [askr options] files..."
+              << std::endl;
+  }
+} // namespace
+
+int
+main(int argc, char **argv)
+{
+  Settings settings;
+  int c;
+
+  while ((c = getopt(argc, argv, "+a:t:c:r:B:S:T:svh")) != -1) {
+    switch (c) {
+    case 'a':
+      settings.askr = optarg;
+      break;
+    case 't':
+      settings.threads = split(optarg);
+      break;
+    case 'c':
+      settings.caches = split(optarg);
+      break;
+    case 'r':
+      settings.repeat = std::max(1ul, strtoul(optarg, nullptr, 10));
+      break;
+    case 'B':
+      settings.baseline = optarg;
+      break;
+    case 'S':
+      settings.save = optarg;
+      break;
+    case 'T':
+      settings.tolerance = strtod(optarg, nullptr);
+      break;
+    case 's':
+      settings.stages = true;
+      break;
+    case 'v':
+      settings.verbose = true;
+      break;
+    default:
+      usage();
+      return c == 'h' ? 0 : 1;
+    }
+  }
+
+  if (optind >= argc) {
+    usage();
+    return 1;
+  }
+  if (settings.threads.empty()) {
+    settings.threads.push_back("");
+  }
+  if (settings.caches.empty()) {
+    settings.caches = {"cold", "warm"};
+  }
+
+  std::string script = argv[optind];
+  std::vector<std::string> files;
+  uint64_t bytes = 0;
+  struct stat st;
+
+  for (int ix = optind + 1; ix < argc; ++ix) {
+    if (stat(argv[ix], &st) == 0 && S_ISREG(st.st_mode)) {
+      files.push_back(argv[ix]);
+      bytes += st.st_size;
+    }
+  }
+
+  std::map<std::string, double> baseline;
+
+  if (!settings.baseline.empty()) {
+    std::ifstream in(settings.baseline);
+
+    for (std::string line; std::getline(in, line);) {
+      baseline[key(field(line, "script"), field(line, "threads"), field(line, "cache"))] = std::stod("0" + field(line, "seconds"));
+    }
+  }
+
+  std::vector<std::string> results;
+  bool regressed = false;
+
+  for (auto const &threads : settings.threads) {
+    for (auto const &cache_state : settings.caches) {
+      std::vector<std::string> args = {settings.askr, script};
+      Result best;
+
+      if (!threads.empty()) {
+        args.push_back("-t");
+        args.push_back(threads);
+      }
+      args.insert(args.end(), argv + optind + 1, argv + argc);
+
+      // The repeats, and then the untimed run with --stats for the stages
+      for (size_t rep = 0; rep < settings.repeat + settings.stages; ++rep) {
+        Result res;
+
+        if (rep == settings.repeat) {
+          args.insert(args.begin() + 2, "--stats");
+        }
+        for (auto const &file : files) {
+          cache(file, cache_state == "warm");
+        }
+        if (!run(settings, args, res)) {
+          std::cerr << "askr-harness: " << settings.askr << " failed, run with -v for its errors" << std::endl;
+          return 1;
+        }
+        if (rep == settings.repeat) {
+          best.stages = res.stages;
+        } else if (rep == 0 || res.seconds < best.seconds) {
+          res.max_rss = std::max(res.max_rss, best.max_rss);
+          best        = res;
+        } else {
+          best.max_rss = std::max(res.max_rss, best.max_rss);
+        }
+      }
+      best.script  = script.substr(script.rfind('/') + 1);
+      best.threads = threads;
+      best.cache   = cache_state;
+      best.bytes   = bytes;
+
+      std::string line = json(best);
+
+      if (auto base = baseline.find(key(best.script, threads, cache_state)); base != baseline.end() && base->second > 0) {
+        double change = (best.seconds / base->second - 1.0) * 100.0;
+        char buf[64];
+
+        snprintf(buf, sizeof(buf), ",\"baseline\":%.3f,\"change_pct\":%.1f}", base->second, change);
+        line.pop_back();
+        line += buf;
+        if (change > settings.tolerance) {
+          std::cerr << "askr-harness: REGRESSION " << key(best.script, threads, cache_state) << " is " << change
+                    << "% slower than the baseline" << std::endl;
+          regressed = true;
+        }
+      }
+      std::cout << line << std::endl;
+      results.push_back(json(best));
+    }
+  }
+
+  if (!settings.save.empty()) {
+    std::ofstream out(settings.save);
+
+    for (auto const &line : results) {
+      out << line << "\n";
+    }
+  }
+
+  return regressed ? 2 : 0;
+}